@@ -1,4 +1,5 @@
 #include "Camera.h"
+#include "Profiler.h"
 #include <cmath>
 
 Camera::Camera(float focalLength, float fAW, float fAH, float nCP, float fCP, Vec3f pos, Vec3f rot)
@@ -9,8 +10,9 @@ constexpr double PI = 3.14159;
 float cosf(float angle) { return (float)(cos(angle * PI/180)); }
 float sinf(float angle) { return (float)(sin(angle * PI/180)); }
 
-Matrix44f Camera::getCameraToWorld()
+Matrix44f Camera::getCameraToWorld() const
 {
+    PROFILE_SCOPE("camera_setup");
     float r = rotation.x;
     float s = rotation.y;
     float t = rotation.z;
@@ -66,3 +68,28 @@ Matrix44f Camera::getCameraToWorld()
 
     return cameraToWorld;
 }
+
+// [comment]
+// Folds the pinhole camera's screen, NDC and raster steps into one matrix. With right = (aperture width / 2) / focal length * near,
+// raster.x = (screen.x + right) / (2 * right) * imageWidth, where screen.x = x / -z * near. Near cancels out, which leaves
+// raster.x = imageWidth * focal length / aperture width * x / -z + imageWidth / 2, and y is the same but flipped.
+// w is -z, and z is mapped to [-1, 1] between the clipping planes.
+// [/comment]
+Matrix44f Camera::getProjection(uint32_t imageWidth, uint32_t imageHeight) const
+{
+    float w = (float)imageWidth, h = (float)imageHeight;
+    float n = _nearClippingPlane, f = _farClippingPlane;
+    return Matrix44f
+    (
+        w * _focalLength / _filmApertureWidth, 0, 0, 0,
+        0, -h * _focalLength / _filmApertureHeight, 0, 0,
+        -w / 2, -h / 2, -(f + n) / (f - n), -1,
+        0, 0, -2 * f * n / (f - n), 0
+    );
+}
+
+float Camera::pixelsPerUnit(float depth, uint32_t imageHeight) const
+{
+    // The film gate spans _filmApertureHeight at _focalLength from the eye, so at a given depth the visible height is depth * aperture / focal length
+    return imageHeight * _focalLength / (_filmApertureHeight * depth);
+}
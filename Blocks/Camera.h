@@ -7,7 +7,19 @@ class Camera
 {
 public:
     Camera(float focalLength, float fAW, float fAH, float nCP, float fCP, Vec3f pos, Vec3f rot);    
-    Matrix44f getCameraToWorld();
+    Matrix44f getCameraToWorld() const;
+
+    // Perspective projection and viewport together, taking camera space to homogeneous raster space (divide x and y by w)
+    Matrix44f getProjection(uint32_t imageWidth, uint32_t imageHeight) const;
+
+    // Number of pixels a world-space length covers when it lies at the given depth in front of the camera
+    float pixelsPerUnit(float depth, uint32_t imageHeight) const;
+
+    float getFocalLength() const { return _focalLength; }
+    float getFilmApertureWidth() const { return _filmApertureWidth; }
+    float getFilmApertureHeight() const { return _filmApertureHeight; }
+    float getNearClippingPlane() const { return _nearClippingPlane; }
+    float getFarClippingPlane() const { return _farClippingPlane; }
 
     Vec3f position;     // Position in world coordinates
     Vec3f rotation;     // Rotation ...
@@ -0,0 +1,132 @@
+#include "Instancing.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // Largest distance (in world units) between a vertex and its counterpart for two objects to count as the same mesh
+    constexpr float MATCH_TOLERANCE = 1e-4f;
+
+    Vec3f centroid(const std::vector<Vec3f>& vertices)
+    {
+        Vec3f sum;
+        for (const Vec3f& v : vertices) { sum = sum + v; }
+        return sum * (1.0f / vertices.size());
+    }
+
+    // Orthonormal basis (as matrix rows) built from the vertices at i0, i1 and i2
+    Matrix44f frame(const std::vector<Vec3f>& vertices, int i0, int i1, int i2)
+    {
+        Vec3f e1 = (vertices[i1] - vertices[i0]).normalize();
+        Vec3f e2 = vertices[i2] - vertices[i0];
+        e2 = (e2 - e1 * e2.dotProduct(e1)).normalize();
+        Vec3f e3 = e1.crossProduct(e2);
+        return Matrix44f(e1.x, e1.y, e1.z, 0, e2.x, e2.y, e2.z, 0, e3.x, e3.y, e3.z, 0, 0, 0, 0, 1);
+    }
+
+    // Find the rotation and translation taking the mesh's (local) vertices onto the object's vertices, index for index.
+    // Fails if the vertex lists differ by anything other than a rigid transform.
+    bool findTransform(const std::vector<Vec3f>& local, const std::vector<Vec3f>& world, Matrix44f& transform)
+    {
+        if (local.size() != world.size() || local.size() < 3) { return false; }
+
+        // Two more vertices that aren't collinear with the first one are needed to pin down the rotation
+        int i1 = -1, i2 = -1;
+        for (size_t i{1}; i < local.size() && i1 < 0; ++i)
+        {
+            if ((local[i] - local[0]).length() > MATCH_TOLERANCE * 100) { i1 = (int)i; }
+        }
+        if (i1 < 0) { return false; }
+        Vec3f axis = (local[i1] - local[0]).normalize();
+        for (size_t i{1}; i < local.size() && i2 < 0; ++i)
+        {
+            if ((local[i] - local[0]).crossProduct(axis).length() > MATCH_TOLERANCE * 100) { i2 = (int)i; }
+        }
+        if (i2 < 0) { return false; }
+
+        // Points are row vectors, so a local direction d maps to d * R. With the frames as rows, localFrame * R = worldFrame.
+        Matrix44f rotation = frame(local, 0, i1, i2).transposed() * frame(world, 0, i1, i2);
+        Vec3f translation;
+        rotation.multDirMatrix(local[0], translation);
+        translation = world[0] - translation;
+
+        transform = rotation;
+        transform[3][0] = translation.x;
+        transform[3][1] = translation.y;
+        transform[3][2] = translation.z;
+
+        for (size_t i{0}; i < local.size(); ++i)
+        {
+            Vec3f v;
+            transform.multVecMatrix(local[i], v);
+            if ((v - world[i]).length() > MATCH_TOLERANCE) { return false; }
+        }
+        return true;
+    }
+}
+
+InstancedScene::InstancedScene(const std::vector<SceneObject>& objects)
+{
+    for (const SceneObject& object : objects)
+    {
+        int meshIndex = -1;
+        Matrix44f transform;
+        for (size_t m{0}; m < _meshes.size() && meshIndex < 0; ++m)
+        {
+            if (_meshes[m].triangles == object.getTriangles() && findTransform(_meshes[m].vertices, object.getVertices(), transform))
+            {
+                meshIndex = (int)m;
+            }
+        }
+
+        if (meshIndex < 0)
+        {
+            // First time this geometry is seen, store it centered on its centroid so the instance transform is a plain translation
+            Vec3f center = centroid(object.getVertices());
+            Mesh mesh;
+            mesh.triangles = object.getTriangles();
+            for (const Vec3f& v : object.getVertices())
+            {
+                mesh.vertices.push_back(v - center);
+            }
+            meshIndex = (int)_meshes.size();
+            _meshes.push_back(std::move(mesh));
+
+            transform = Matrix44f();
+            transform[3][0] = center.x;
+            transform[3][1] = center.y;
+            transform[3][2] = center.z;
+        }
+
+        _instanceMeshes.push_back(meshIndex);
+        _transforms.push_back(transform);
+        _names.push_back(object.getName());
+        _versions.push_back(0);
+    }
+}
+
+void InstancedScene::setTransform(size_t instance, const Matrix44f& transform)
+{
+    Matrix44f current = _transforms.get(instance);
+    if (std::equal(&transform[0][0], &transform[0][0] + 16, &current[0][0])) { return; }
+    _transforms.set(instance, transform);
+    _versions[instance]++;
+}
+
+void InstancedScene::buildLODs(int maxLevels)
+{
+    JobSystem::instance().parallelFor(_meshes.size(), 1, [&](size_t begin, size_t end)
+    {
+        for (size_t m{begin}; m < end; ++m) { _meshes[m].lods = LODChain(_meshes[m].vertices, _meshes[m].triangles, maxLevels); }
+    });
+    for (uint64_t& version : _versions)
+    {
+        version++;
+    }
+}
+
+void InstancedScene::computeInstanceToCamera(const Matrix44f& worldToCamera, Matrix44Batch& instanceToCamera) const
+{
+    Matrix44Batch::multiply(_transforms, worldToCamera, instanceToCamera);
+}
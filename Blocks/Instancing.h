@@ -0,0 +1,51 @@
+// Instancing: objects that are copies of the same geometry (e.g. the blocks) share one vertex and index buffer,
+// and each copy only stores the transform placing it in the world.
+#pragma once
+
+#include "geometry.h"
+#include "LOD.h"
+#include "MatrixBatch.h"
+#include "SceneObject.h"
+#include <string>
+#include <vector>
+
+// Geometry shared by all its instances, in the mesh's own local space
+struct Mesh
+{
+    std::vector<Vec3f> vertices;
+    std::vector<int> triangles;
+    LODChain lods;
+};
+
+class InstancedScene
+{
+public:
+    // Objects whose vertices are a rotated and translated copy of an earlier object's (with the same faces) become instances of its mesh
+    InstancedScene(const std::vector<SceneObject>& objects);
+
+    void buildLODs(int maxLevels = 6);
+
+    // Concatenate every instance's transform with the camera's, all in one batch, so vertices go straight from mesh to camera space
+    void computeInstanceToCamera(const Matrix44f& worldToCamera, Matrix44Batch& instanceToCamera) const;
+
+    size_t getInstanceCount() const { return _transforms.size(); }
+    const std::vector<Mesh>& getMeshes() const { return _meshes; }
+    const std::vector<int>& getInstanceMeshes() const { return _instanceMeshes; }
+    Matrix44f getTransform(size_t instance) const { return _transforms.get(instance); }
+    const Matrix44Batch& getTransforms() const { return _transforms; }
+    const std::vector<std::string>& getNames() const { return _names; }
+
+    // Per instance, bumped every time what it draws changes (its transform, or its mesh's LODs), so renderers can tell what to redo
+    const std::vector<uint64_t>& getVersions() const { return _versions; }
+
+    // Move an instance, e.g. to the world matrix of its scene graph node. Setting the transform it already has is not a change.
+    void setTransform(size_t instance, const Matrix44f& transform);
+
+private:
+    std::vector<Mesh> _meshes;
+    // Per instance, kept in separate arrays so the batch transform only walks the matrices
+    std::vector<int> _instanceMeshes;       // Index into _meshes
+    Matrix44Batch _transforms;              // Mesh to world
+    std::vector<std::string> _names;
+    std::vector<uint64_t> _versions;
+};
@@ -0,0 +1,325 @@
+#include "JobSystem.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+    // Worker index of the current thread in the system it belongs to, -1 for threads that aren't workers
+    thread_local const JobSystem* currentSystem = nullptr;
+    thread_local int currentWorker = -1;
+
+    unsigned configuredWorkers = 0;
+    bool configuredPinning = false;
+
+    // Parse a sysfs cpu list such as "0-3,8-11"
+    std::vector<int> parseCpuList(const std::string& list)
+    {
+        std::vector<int> cpus;
+        std::stringstream ss(list);
+        std::string range;
+        while (std::getline(ss, range, ','))
+        {
+            size_t dash = range.find('-');
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu{first}; cpu <= last; ++cpu) { cpus.push_back(cpu); }
+        }
+        return cpus;
+    }
+
+    // CPUs of every NUMA node. Without that information (or off Linux) the machine counts as one node with every CPU.
+    std::vector<std::vector<int>> readNumaNodes()
+    {
+        std::vector<std::vector<int>> nodes;
+        for (int node{0}; ; ++node)
+        {
+            std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            std::string list;
+            if (!file.is_open() || !std::getline(file, list)) { break; }
+            if (!list.empty()) { nodes.push_back(parseCpuList(list)); }
+        }
+        if (nodes.empty())
+        {
+            nodes.emplace_back();
+            for (int cpu{0}; cpu < (int)std::max(1u, std::thread::hardware_concurrency()); ++cpu) { nodes.back().push_back(cpu); }
+        }
+        return nodes;
+    }
+}
+
+bool JobSystem::Deque::push(Job* job)
+{
+    int64_t bottom = _bottom.load();
+    if (bottom - _top.load() >= CAPACITY) { return false; }
+    _jobs[bottom % CAPACITY].store(job);
+    _bottom.store(bottom + 1);
+    return true;
+}
+
+JobSystem::Job* JobSystem::Deque::pop()
+{
+    int64_t bottom = _bottom.load() - 1;
+    _bottom.store(bottom);
+    int64_t top = _top.load();
+    if (top > bottom)
+    {
+        // Empty
+        _bottom.store(bottom + 1);
+        return nullptr;
+    }
+    Job* job = _jobs[bottom % CAPACITY].load();
+    if (top == bottom)
+    {
+        // Last job, which a thief may be taking at the same time: whoever moves top first gets it
+        if (!_top.compare_exchange_strong(top, top + 1)) { job = nullptr; }
+        _bottom.store(bottom + 1);
+    }
+    return job;
+}
+
+JobSystem::Job* JobSystem::Deque::steal()
+{
+    int64_t top = _top.load();
+    int64_t bottom = _bottom.load();
+    if (top >= bottom) { return nullptr; }
+    Job* job = _jobs[top % CAPACITY].load();
+    if (!_top.compare_exchange_strong(top, top + 1)) { return nullptr; }
+    return job;
+}
+
+JobSystem::JobSystem(unsigned workerCount, bool pinWorkers)
+{
+    if (workerCount == 0) { workerCount = std::max(1u, std::thread::hardware_concurrency()) - 1; }
+
+    // Workers fill the CPUs node by node, so neighbouring workers share a node
+    std::vector<std::vector<int>> nodes = readNumaNodes();
+    std::vector<int> cpus, cpuNodes;
+    for (size_t node{0}; node < nodes.size(); ++node)
+    {
+        for (int cpu : nodes[node])
+        {
+            cpus.push_back(cpu);
+            cpuNodes.push_back((int)node);
+        }
+    }
+
+    std::vector<int> workerNodes(workerCount);
+    for (unsigned w{0}; w < workerCount; ++w)
+    {
+        _deques.push_back(std::make_unique<Deque>());
+        workerNodes[w] = cpuNodes[w % cpus.size()];
+        _allWorkers.push_back((int)w);
+    }
+    for (unsigned w{0}; w < workerCount; ++w)
+    {
+        // Victims on the same node first, then the rest, each starting after this worker so thieves spread out
+        std::vector<int> order;
+        for (bool sameNode : {true, false})
+        {
+            for (unsigned i{1}; i < workerCount; ++i)
+            {
+                int victim = (int)((w + i) % workerCount);
+                if ((workerNodes[victim] == workerNodes[w]) == sameNode) { order.push_back(victim); }
+            }
+        }
+        _stealOrder.push_back(std::move(order));
+    }
+
+    for (unsigned w{0}; w < workerCount; ++w)
+    {
+        _threads.emplace_back([this, w]() { workerLoop((int)w); });
+#ifdef __linux__
+        if (pinWorkers)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpus[w % cpus.size()], &set);
+            pthread_setaffinity_np(_threads.back().native_handle(), sizeof(set), &set);
+        }
+#else
+        (void)pinWorkers;
+#endif
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    shutdown();
+}
+
+JobSystem& JobSystem::instance()
+{
+    static JobSystem jobs(configuredWorkers, configuredPinning);
+    return jobs;
+}
+
+void JobSystem::configure(unsigned workerCount, bool pinWorkers)
+{
+    configuredWorkers = workerCount;
+    configuredPinning = pinWorkers;
+}
+
+void JobSystem::run(std::function<void()> job, JobCounter& counter)
+{
+    counter++;
+    if (_threads.empty())
+    {
+        job();
+        counter--;
+        return;
+    }
+
+    Job* entry = new Job{std::move(job), &counter};
+    _queued++;
+    if (currentSystem != this || !_deques[currentWorker]->push(entry))
+    {
+        std::lock_guard<std::mutex> lock(_injectedMutex);
+        _injected.push_back(entry);
+        _injectedCount++;
+    }
+    // Taking the lock orders this with a worker checking _queued before it goes to sleep, so the wake up can't be missed
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+    }
+    _wake.notify_one();
+}
+
+// [comment]
+// The worker's own jobs first, then other workers', without taking any lock. Only then the injected queue, and its lock only when
+// the count says it holds something, so idle workers don't line up on one mutex while there is work to steal.
+// [/comment]
+JobSystem::Job* JobSystem::findJob(int worker)
+{
+    Job* job = nullptr;
+    if (worker >= 0) { job = _deques[worker]->pop(); }
+    if (!job)
+    {
+        for (int victim : worker >= 0 ? _stealOrder[worker] : _allWorkers)
+        {
+            if ((job = _deques[victim]->steal())) { break; }
+        }
+    }
+    if (!job && _injectedCount > 0)
+    {
+        std::lock_guard<std::mutex> lock(_injectedMutex);
+        if (!_injected.empty())
+        {
+            job = _injected.front();
+            _injected.pop_front();
+            _injectedCount--;
+        }
+    }
+    if (job) { _queued--; }
+    return job;
+}
+
+void JobSystem::execute(Job* job)
+{
+    job->function();
+    (*job->counter)--;
+    delete job;
+}
+
+void JobSystem::workerLoop(int worker)
+{
+    currentSystem = this;
+    currentWorker = worker;
+    while (true)
+    {
+        if (Job* job = findJob(worker))
+        {
+            execute(job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        if (_stopping && _queued == 0) { break; }
+        _wake.wait(lock, [&]() { return _queued > 0 || _stopping; });
+    }
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+    int worker = currentSystem == this ? currentWorker : -1;
+    while (counter > 0)
+    {
+        if (Job* job = findJob(worker))
+        {
+            execute(job);
+        } else
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body)
+{
+    grain = std::max<size_t>(1, grain);
+    JobCounter counter{0};
+    for (size_t begin{0}; begin < count; begin += grain)
+    {
+        size_t end = std::min(count, begin + grain);
+        run([&body, begin, end]() { body(begin, end); }, counter);
+    }
+    wait(counter);
+}
+
+void JobSystem::shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _stopping = true;
+    }
+    _wake.notify_all();
+    for (std::thread& thread : _threads)
+    {
+        thread.join();
+    }
+    _threads.clear();
+}
+
+int TaskGraph::addTask(std::function<void()> work, const std::vector<int>& dependencies)
+{
+    int id = (int)_tasks.size();
+    Task& task = _tasks.emplace_back();
+    task.work = std::move(work);
+    task.dependencyCount = (int)dependencies.size();
+    for (int dependency : dependencies)
+    {
+        _tasks[dependency].successors.push_back(id);
+    }
+    return id;
+}
+
+void TaskGraph::launch(JobSystem& jobs, int task, JobCounter& counter)
+{
+    jobs.run([this, &jobs, task, &counter]()
+    {
+        _tasks[task].work();
+        // Successors are queued before this job counts as finished, so the counter can't reach zero early
+        for (int successor : _tasks[task].successors)
+        {
+            if (--_tasks[successor].remaining == 0) { launch(jobs, successor, counter); }
+        }
+    }, counter);
+}
+
+void TaskGraph::run(JobSystem& jobs)
+{
+    for (Task& task : _tasks)
+    {
+        task.remaining = task.dependencyCount;
+    }
+    JobCounter counter{0};
+    for (size_t t{0}; t < _tasks.size(); ++t)
+    {
+        if (_tasks[t].dependencyCount == 0) { launch(jobs, (int)t, counter); }
+    }
+    jobs.wait(counter);
+}
@@ -0,0 +1,124 @@
+// One pool of worker threads shared by everything that runs in parallel (loading, LOD building, projection and svg output),
+// so the stages never compete with each other for cores with threads of their own.
+//
+// Every worker has its own deque of jobs: it pushes and pops at one end without locking, and idle workers steal from the other end.
+// Workers prefer to steal from workers on the same NUMA node, so a job's data tends to stay in the memory closest to where it runs.
+// A thread waiting on jobs runs jobs itself in the meantime, which also makes nested parallelism (a job waiting on jobs) safe.
+//
+//     JobSystem::instance().parallelFor(objects.size(), 1, [&](size_t begin, size_t end) { ... });
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of jobs of a group still running. run() adds to it and every job takes itself off once done.
+using JobCounter = std::atomic<int>;
+
+class JobSystem
+{
+public:
+    // workerCount 0 means one worker per hardware thread, less one for the thread that submits the work.
+    // pinWorkers binds every worker to one core, filling NUMA nodes one after the other.
+    explicit JobSystem(unsigned workerCount = 0, bool pinWorkers = false);
+    ~JobSystem();
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // The system shared by the whole program, created on first use with the settings from configure (default: every core, unpinned)
+    static JobSystem& instance();
+    static void configure(unsigned workerCount, bool pinWorkers);
+
+    void run(std::function<void()> job, JobCounter& counter);
+
+    // Returns once every job of the counter has finished, running jobs on this thread until then
+    void wait(JobCounter& counter);
+
+    // Calls body(begin, end) over [0, count) in chunks of grain elements, and returns once all of them are done
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body);
+
+    // Finishes the queued jobs and joins the workers, e.g. so their profiling data is merged before a report.
+    // Jobs run after this are run straight away on the calling thread.
+    void shutdown();
+
+    unsigned getWorkerCount() const { return (unsigned)_threads.size(); }
+
+private:
+    struct Job
+    {
+        std::function<void()> function;
+        JobCounter* counter;
+    };
+
+    // [comment]
+    // Chase-Lev work stealing deque (Lê, Pop, Cohen and Zappa Nardelli, "Correct and Efficient Work-Stealing for Weak Memory Models", 2013)
+    // with a fixed capacity: push and pop are only called by the owning worker, steal by anyone.
+    // [/comment]
+    class Deque
+    {
+    public:
+        static constexpr int64_t CAPACITY = 4096;
+
+        bool push(Job* job);
+        Job* pop();
+        Job* steal();
+
+    private:
+        std::atomic<int64_t> _top{0}, _bottom{0};
+        std::atomic<Job*> _jobs[CAPACITY];
+    };
+
+    void workerLoop(int worker);
+    Job* findJob(int worker);
+    void execute(Job* job);
+
+    std::vector<std::unique_ptr<Deque>> _deques;    // One per worker
+    std::vector<std::vector<int>> _stealOrder;      // Per worker, the others to steal from: same NUMA node first
+    std::vector<int> _allWorkers;                   // Steal order of threads that aren't workers
+    std::vector<std::thread> _threads;
+
+    // Jobs submitted by threads that aren't workers. The count is read without the lock, to skip it when the queue is empty.
+    std::mutex _injectedMutex;
+    std::deque<Job*> _injected;
+    std::atomic<int> _injectedCount{0};
+
+    // Idle workers sleep until a job is queued
+    std::atomic<int> _queued{0};
+    std::atomic<bool> _stopping{false};
+    std::mutex _sleepMutex;
+    std::condition_variable _wake;
+};
+
+// [comment]
+// Tasks with dependencies between them: a task only starts once every task it depends on has finished.
+// Independent tasks run in parallel on the job system.
+// [/comment]
+class TaskGraph
+{
+public:
+    // Returns the task's id, which later tasks list as a dependency
+    int addTask(std::function<void()> work, const std::vector<int>& dependencies = {});
+
+    // Runs every task and returns once all of them are done. The graph can be run again.
+    void run(JobSystem& jobs = JobSystem::instance());
+
+private:
+    struct Task
+    {
+        std::function<void()> work;
+        std::vector<int> successors;
+        int dependencyCount = 0;
+        std::atomic<int> remaining{0};   // Dependencies not finished yet, during a run
+    };
+
+    void launch(JobSystem& jobs, int task, JobCounter& counter);
+
+    std::deque<Task> _tasks;    // Deque since tasks hold atomics, which can't move
+};
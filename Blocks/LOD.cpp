@@ -0,0 +1,441 @@
+#include "LOD.h"
+#include "SceneObject.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <queue>
+#include <sstream>
+
+namespace
+{
+    // Symmetric 4x4 matrix measuring the sum of squared distances from a point to a set of planes.
+    // Only the upper triangle is stored: aa ab ac ad bb bc bd cc cd dd
+    struct Quadric
+    {
+        double q[10] = {0};
+        // Total area of the faces whose planes were added. The sum of squared distances divided by it is a mean squared distance, in
+        // world units squared. Boundary planes aren't counted, so moving off a boundary only raises that mean.
+        double area = 0;
+
+        void addPlane(double a, double b, double c, double d, double weight)
+        {
+            q[0] += weight * a * a; q[1] += weight * a * b; q[2] += weight * a * c; q[3] += weight * a * d;
+            q[4] += weight * b * b; q[5] += weight * b * c; q[6] += weight * b * d;
+            q[7] += weight * c * c; q[8] += weight * c * d;
+            q[9] += weight * d * d;
+        }
+
+        Quadric& operator += (const Quadric& other)
+        {
+            for (int i{0}; i < 10; ++i) { q[i] += other.q[i]; }
+            area += other.area;
+            return *this;
+        }
+
+        double evaluate(const Vec3f& v) const
+        {
+            double x = v.x, y = v.y, z = v.z;
+            return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x
+                 + q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y
+                 + q[7] * z * z + 2 * q[8] * z
+                 + q[9];
+        }
+
+        // The point minimizing the error solves A v = -b, where A is the upper 3x3 block. Fails when A is (nearly) singular, e.g. on flat regions.
+        bool optimum(Vec3f& v) const
+        {
+            double det = q[0] * (q[4] * q[7] - q[5] * q[5]) - q[1] * (q[1] * q[7] - q[5] * q[2]) + q[2] * (q[1] * q[5] - q[4] * q[2]);
+            if (std::fabs(det) < 1e-10) { return false; }
+
+            // Cramer's rule
+            double bx = -q[3], by = -q[6], bz = -q[8];
+            double dx = bx * (q[4] * q[7] - q[5] * q[5]) - q[1] * (by * q[7] - q[5] * bz) + q[2] * (by * q[5] - q[4] * bz);
+            double dy = q[0] * (by * q[7] - bz * q[5]) - bx * (q[1] * q[7] - q[5] * q[2]) + q[2] * (q[1] * bz - by * q[2]);
+            double dz = q[0] * (q[4] * bz - q[5] * by) - q[1] * (q[1] * bz - by * q[2]) + bx * (q[1] * q[5] - q[4] * q[2]);
+            v = Vec3f((float)(dx / det), (float)(dy / det), (float)(dz / det));
+            return true;
+        }
+    };
+
+    struct Collapse
+    {
+        double cost;            // Area weighted sum of squared distances, which orders the collapses
+        double distance;        // Root mean squared distance (world units) from target to the planes of the merged quadric
+        int v0, v1;
+        int stamp0, stamp1;     // Versions of v0 and v1 when this entry was pushed, a mismatch means it is stale
+        Vec3f target;
+        bool operator > (const Collapse& other) const { return cost > other.cost; }
+    };
+
+    Vec3f faceNormal(const Vec3f& a, const Vec3f& b, const Vec3f& c)
+    {
+        return (b - a).crossProduct(c - a);
+    }
+
+    // [comment]
+    // Collapses edges of a mesh in order of increasing quadric cost. Simplification can be resumed with a lower target, so the levels of
+    // a chain are cut from one run: the quadrics keep collecting the planes of the original faces, and the error of every level is
+    // measured against the original mesh rather than against the level before it.
+    // [/comment]
+    class Simplifier
+    {
+    public:
+        Simplifier(const std::vector<Vec3f>& vertices, const std::vector<int>& triangles);
+
+        // Collapse edges until at most targetTriangles triangles are left, or no collapse is possible
+        void simplify(size_t targetTriangles);
+
+        size_t getTriangleCount() const { return _triangleCount; }
+
+        // Largest distance (world units) of any collapse so far between the vertex it kept and the original faces it replaced,
+        // as the root mean squared distance to their planes
+        float getError() const { return (float)_maxDistance; }
+
+        // The surviving triangles and the vertices they still use
+        void extract(std::vector<Vec3f>& outVertices, std::vector<int>& outTriangles) const;
+
+    private:
+        Collapse makeCollapse(int v0, int v1) const;
+
+        std::vector<Vec3f> _positions;
+        std::vector<int> _triangles;
+        size_t _triangleCount;
+        std::vector<Quadric> _quadrics;
+        std::vector<std::vector<int>> _vertexTriangles;
+        std::vector<bool> _triangleAlive, _vertexAlive;
+        std::vector<int> _stamps;
+        std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> _heap;
+        double _maxDistance = 0;
+    };
+
+    Simplifier::Simplifier(const std::vector<Vec3f>& vertices, const std::vector<int>& triangles)
+        : _positions(vertices), _triangles(triangles), _triangleCount(triangles.size() / 3), _quadrics(vertices.size()),
+          _vertexTriangles(vertices.size()), _triangleAlive(_triangleCount, true), _vertexAlive(vertices.size(), true), _stamps(vertices.size(), 0)
+    {
+        const std::vector<Vec3f>& positions = _positions;
+        const std::vector<int>& tris = _triangles;
+
+        // Every triangle adds its plane to the quadrics of its corners, weighted by area so large faces dominate
+        for (size_t i{0}; i < _triangleCount; ++i)
+        {
+            const Vec3f& a = positions[tris[i * 3]];
+            Vec3f n = faceNormal(a, positions[tris[i * 3 + 1]], positions[tris[i * 3 + 2]]);
+            float area = n.length();
+            if (area > 0) { n /= area; }
+            double d = -n.dotProduct(a);
+            for (int k{0}; k < 3; ++k)
+            {
+                _quadrics[tris[i * 3 + k]].addPlane(n.x, n.y, n.z, d, area);
+                _quadrics[tris[i * 3 + k]].area += area;
+                _vertexTriangles[tris[i * 3 + k]].push_back((int)i);
+            }
+        }
+
+        // Edges used by a single triangle lie on an open boundary. Add a heavily weighted plane through the edge, perpendicular to the face,
+        // so the outline of the mesh (e.g. the floor's edges) is kept in place.
+        std::vector<std::pair<int, int>> edges;
+        for (size_t i{0}; i < _triangleCount; ++i)
+        {
+            for (int k{0}; k < 3; ++k)
+            {
+                int a = tris[i * 3 + k], b = tris[i * 3 + (k + 1) % 3];
+                edges.emplace_back(std::min(a, b), std::max(a, b));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        for (size_t i{0}; i < edges.size(); )
+        {
+            size_t j = i;
+            while (j < edges.size() && edges[j] == edges[i]) { ++j; }
+            if (j - i == 1)
+            {
+                int a = edges[i].first, b = edges[i].second;
+                for (int t : _vertexTriangles[a])
+                {
+                    const int* c = &tris[t * 3];
+                    if (c[0] != b && c[1] != b && c[2] != b) { continue; }
+                    Vec3f n = faceNormal(positions[c[0]], positions[c[1]], positions[c[2]]);
+                    Vec3f side = (positions[b] - positions[a]).crossProduct(n).normalize();
+                    double d = -side.dotProduct(positions[a]);
+                    double weight = 1000 * (positions[b] - positions[a]).norm();
+                    _quadrics[a].addPlane(side.x, side.y, side.z, d, weight);
+                    _quadrics[b].addPlane(side.x, side.y, side.z, d, weight);
+                }
+            }
+            i = j;
+        }
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+        for (const auto& [a, b] : edges)
+        {
+            _heap.push(makeCollapse(a, b));
+        }
+    }
+
+    Collapse Simplifier::makeCollapse(int v0, int v1) const
+    {
+        Quadric q = _quadrics[v0];
+        q += _quadrics[v1];
+
+        Collapse c{0, 0, v0, v1, _stamps[v0], _stamps[v1], Vec3f()};
+        Vec3f candidates[3] = {_positions[v0], _positions[v1], (_positions[v0] + _positions[v1]) * 0.5f};
+        c.cost = -1;
+        if (q.optimum(c.target))
+        {
+            c.cost = q.evaluate(c.target);
+        }
+        for (const Vec3f& candidate : candidates)
+        {
+            double cost = q.evaluate(candidate);
+            if (c.cost < 0 || cost < c.cost)
+            {
+                c.cost = cost;
+                c.target = candidate;
+            }
+        }
+        c.cost = std::max(c.cost, 0.0);
+        c.distance = q.area > 0 ? std::sqrt(c.cost / q.area) : 0;
+        return c;
+    }
+
+    void Simplifier::simplify(size_t targetTriangles)
+    {
+        std::vector<Vec3f>& positions = _positions;
+        std::vector<int>& tris = _triangles;
+        while (_triangleCount > targetTriangles && !_heap.empty())
+        {
+            Collapse c = _heap.top();
+            _heap.pop();
+            if (!_vertexAlive[c.v0] || !_vertexAlive[c.v1] || _stamps[c.v0] != c.stamp0 || _stamps[c.v1] != c.stamp1) { continue; }
+
+            // Reject collapses that would flip a surviving triangle around either vertex
+            bool flips = false;
+            for (int v : {c.v0, c.v1})
+            {
+                for (int t : _vertexTriangles[v])
+                {
+                    if (!_triangleAlive[t]) { continue; }
+                    int* corner = &tris[t * 3];
+                    bool shared = (corner[0] == c.v0 || corner[1] == c.v0 || corner[2] == c.v0) &&
+                                  (corner[0] == c.v1 || corner[1] == c.v1 || corner[2] == c.v1);
+                    if (shared) { continue; }
+
+                    Vec3f p[3] = {positions[corner[0]], positions[corner[1]], positions[corner[2]]};
+                    Vec3f before = faceNormal(p[0], p[1], p[2]);
+                    for (int k{0}; k < 3; ++k)
+                    {
+                        if (corner[k] == v) { p[k] = c.target; }
+                    }
+                    Vec3f after = faceNormal(p[0], p[1], p[2]);
+                    if (before.dotProduct(after) <= 0) { flips = true; }
+                }
+            }
+            if (flips) { continue; }
+
+            // Merge v1 into v0
+            positions[c.v0] = c.target;
+            _quadrics[c.v0] += _quadrics[c.v1];
+            _vertexAlive[c.v1] = false;
+            _maxDistance = std::max(_maxDistance, c.distance);
+
+            for (int t : _vertexTriangles[c.v1])
+            {
+                if (!_triangleAlive[t]) { continue; }
+                int* corner = &tris[t * 3];
+                if (corner[0] == c.v0 || corner[1] == c.v0 || corner[2] == c.v0)
+                {
+                    // Triangle spanned the collapsed edge and degenerates
+                    _triangleAlive[t] = false;
+                    _triangleCount--;
+                    continue;
+                }
+                for (int k{0}; k < 3; ++k)
+                {
+                    if (corner[k] == c.v1) { corner[k] = c.v0; }
+                }
+                _vertexTriangles[c.v0].push_back(t);
+            }
+            _vertexTriangles[c.v1].clear();
+
+            // Costs of every edge around the merged vertex changed
+            std::vector<int> neighbours;
+            for (int t : _vertexTriangles[c.v0])
+            {
+                if (!_triangleAlive[t]) { continue; }
+                for (int k{0}; k < 3; ++k)
+                {
+                    int n = tris[t * 3 + k];
+                    if (n != c.v0 && std::find(neighbours.begin(), neighbours.end(), n) == neighbours.end()) { neighbours.push_back(n); }
+                }
+            }
+            _stamps[c.v0]++;
+            std::vector<std::pair<int, int>> changed;
+            for (int n : neighbours)
+            {
+                _stamps[n]++;
+            }
+            // Bumping the stamps invalidated every edge touching a neighbour, so queue all of them again
+            for (int n : neighbours)
+            {
+                for (int t : _vertexTriangles[n])
+                {
+                    if (!_triangleAlive[t]) { continue; }
+                    for (int k{0}; k < 3; ++k)
+                    {
+                        int m = tris[t * 3 + k];
+                        if (m != n) { changed.emplace_back(std::min(n, m), std::max(n, m)); }
+                    }
+                }
+            }
+            std::sort(changed.begin(), changed.end());
+            changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+            for (const auto& [a, b] : changed)
+            {
+                _heap.push(makeCollapse(a, b));
+            }
+        }
+    }
+
+    void Simplifier::extract(std::vector<Vec3f>& outVertices, std::vector<int>& outTriangles) const
+    {
+        std::vector<int> remap(_positions.size(), -1);
+        outVertices.clear();
+        outTriangles.clear();
+        for (size_t i{0}; i < _triangleAlive.size(); ++i)
+        {
+            if (!_triangleAlive[i]) { continue; }
+            for (int k{0}; k < 3; ++k)
+            {
+                int v = _triangles[i * 3 + k];
+                if (remap[v] < 0)
+                {
+                    remap[v] = (int)outVertices.size();
+                    outVertices.push_back(_positions[v]);
+                }
+                outTriangles.push_back(remap[v]);
+            }
+        }
+    }
+}
+
+float simplifyMesh(const std::vector<Vec3f>& vertices, const std::vector<int>& triangles, size_t targetTriangles,
+                   std::vector<Vec3f>& outVertices, std::vector<int>& outTriangles)
+{
+    Simplifier simplifier(vertices, triangles);
+    simplifier.simplify(targetTriangles);
+    simplifier.extract(outVertices, outTriangles);
+    return simplifier.getError();
+}
+
+LODChain::LODChain(const std::vector<Vec3f>& vertices, const std::vector<int>& triangles, int maxLevels)
+{
+    PROFILE_SCOPE("lod_build");
+    _levels.push_back({vertices, triangles, 0});
+
+    // One simplification run, stopped at half the triangles of each level to take the next one
+    Simplifier simplifier(vertices, triangles);
+    for (int i{1}; i < maxLevels; ++i)
+    {
+        size_t previousCount = _levels.back().triangles.size() / 3;
+        size_t target = previousCount / 2;
+        if (target < 2) { break; }
+
+        simplifier.simplify(target);
+        if (simplifier.getTriangleCount() >= previousCount) { break; }
+
+        // Already the largest error of every collapse since the original mesh, so it isn't added to the previous level's
+        LODLevel level;
+        simplifier.extract(level.vertices, level.triangles);
+        level.error = simplifier.getError();
+        _levels.push_back(std::move(level));
+    }
+
+    computeBounds();
+}
+
+void LODChain::computeBounds()
+{
+    const std::vector<Vec3f>& vertices = _levels[0].vertices;
+    if (vertices.empty()) { return; }
+
+    Vec3f min = vertices[0], max = vertices[0];
+    for (const Vec3f& v : vertices)
+    {
+        for (uint8_t k{0}; k < 3; ++k)
+        {
+            min[k] = std::min(min[k], v[k]);
+            max[k] = std::max(max[k], v[k]);
+        }
+    }
+    _center = (min + max) * 0.5f;
+    _radius = (max - _center).length();
+}
+
+const LODLevel& LODChain::select(const Camera& camera, const Matrix44f& worldToCamera, uint32_t imageHeight, float pixelError) const
+{
+    Vec3f centerCamera;
+    worldToCamera.multVecMatrix(_center, centerCamera);
+
+    // Closest the object gets to the eye. Anything touching the near plane is drawn at full detail.
+    float depth = -centerCamera.z - _radius;
+    if (depth <= camera.getNearClippingPlane()) { return _levels[0]; }
+
+    float pixelsPerUnit = camera.pixelsPerUnit(depth, imageHeight);
+    size_t level = 0;
+    while (level + 1 < _levels.size() && _levels[level + 1].error * pixelsPerUnit <= pixelError)
+    {
+        level++;
+    }
+    return _levels[level];
+}
+
+void LODChain::save(std::ostream& os, std::string name, int& vertexOffset) const
+{
+    for (size_t i{1}; i < _levels.size(); ++i)
+    {
+        const LODLevel& level = _levels[i];
+        os << "o " << name << "_LOD" << i << "\n";
+        os << "# error " << level.error << "\n";
+        for (const Vec3f& v : level.vertices)
+        {
+            os << "v " << v.x << " " << v.y << " " << v.z << "\n";
+        }
+        for (size_t t{0}; t < level.triangles.size(); t += 3)
+        {
+            os << "f " << level.triangles[t] + 1 + vertexOffset << " " << level.triangles[t + 1] + 1 + vertexOffset << " " << level.triangles[t + 2] + 1 + vertexOffset << "\n";
+        }
+        vertexOffset += (int)level.vertices.size();
+    }
+}
+
+LODChain LODChain::load(std::string filename, std::string name, const std::vector<Vec3f>& vertices, const std::vector<int>& triangles)
+{
+    LODChain chain;
+    chain._levels.push_back({vertices, triangles, 0});
+
+    // The geometry of each level is read like any other object, only the error comment needs looking up here
+    std::ifstream inFile(filename);
+    std::string line, temp, current;
+    while (std::getline(inFile, line))
+    {
+        std::istringstream iss{line};
+        iss >> temp;
+        if (temp == "o")
+        {
+            iss >> current;
+        } else if (temp == "#" && iss >> temp && temp == "error" && current == name + "_LOD" + std::to_string(chain._levels.size()))
+        {
+            LODLevel level;
+            iss >> level.error;
+
+            SceneObject object(current, filename);
+            level.vertices = object.getVertices();
+            level.triangles = object.getTriangles();
+            chain._levels.push_back(std::move(level));
+        }
+    }
+
+    chain.computeBounds();
+    return chain;
+}
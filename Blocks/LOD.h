@@ -0,0 +1,48 @@
+// Level of detail (LOD) chains built with quadric error metric edge collapse (Garland & Heckbert, 1997).
+// Each level has roughly half the triangles of the previous one, and the renderer picks the coarsest level
+// whose geometric error stays under a pixel once projected through the current camera.
+#pragma once
+
+#include "geometry.h"
+#include "Camera.h"
+#include <string>
+#include <vector>
+#include <ostream>
+
+struct LODLevel
+{
+    std::vector<Vec3f> vertices;
+    std::vector<int> triangles;
+    float error = 0;    // Largest distance (world units) between this level's vertices and the original faces they replace, from the quadrics
+};
+
+class LODChain
+{
+public:
+    LODChain() {}
+    LODChain(const std::vector<Vec3f>& vertices, const std::vector<int>& triangles, int maxLevels = 6);
+
+    // Pick the coarsest level whose error covers at most pixelError pixels on screen
+    const LODLevel& select(const Camera& camera, const Matrix44f& worldToCamera, uint32_t imageHeight, float pixelError = 1) const;
+
+    // Write every level after level 0 as its own object (name_LOD1, name_LOD2, ...) so the chain can be built offline.
+    // vertexOffset is the number of vertices already written to the stream, and is advanced past the ones written here.
+    void save(std::ostream& os, std::string name, int& vertexOffset) const;
+    // Read back the levels written by save. Level 0 is the object itself and needs to be given.
+    static LODChain load(std::string filename, std::string name, const std::vector<Vec3f>& vertices, const std::vector<int>& triangles);
+
+    size_t size() const { return _levels.size(); }
+    const LODLevel& operator [] (size_t i) const { return _levels[i]; }
+
+private:
+    void computeBounds();
+
+    std::vector<LODLevel> _levels;
+    Vec3f _center;      // Bounding sphere of level 0, used to find how large the object appears on screen
+    float _radius = 0;
+};
+
+// Collapse edges of the mesh until it has at most targetTriangles triangles (or no collapse is possible).
+// Returns the largest error introduced by any collapse, as a distance in world units (see LODLevel::error).
+float simplifyMesh(const std::vector<Vec3f>& vertices, const std::vector<int>& triangles, size_t targetTriangles,
+                   std::vector<Vec3f>& outVertices, std::vector<int>& outTriangles);
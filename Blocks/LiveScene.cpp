@@ -0,0 +1,174 @@
+#include "LiveScene.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // 64 bit FNV-1a
+    uint64_t hashBytes(std::string_view bytes)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (char c : bytes)
+        {
+            hash ^= (unsigned char)c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    std::string readFile(const std::string& filename)
+    {
+        std::ifstream file(filename, std::ios::binary);
+        std::ostringstream contents;
+        contents << file.rdbuf();
+        return contents.str();
+    }
+}
+
+std::vector<ObjBlock> indexObjBlocks(std::string_view contents)
+{
+    std::vector<ObjBlock> blocks;
+    int vertexCount = 0, texCoordCount = 0;
+    std::string_view materialLibrary;
+    for (size_t start{0}; start < contents.size(); )
+    {
+        size_t end = std::min(contents.find('\n', start), contents.size());
+        std::string_view line = contents.substr(start, end - start);
+        if (line.starts_with("o "))
+        {
+            if (!blocks.empty()) { blocks.back().length = start - blocks.back().offset; }
+            std::string_view name = line.substr(2);
+            if (name.ends_with('\r')) { name.remove_suffix(1); }
+            blocks.push_back({std::string(name), std::min(end + 1, contents.size()), 0, vertexCount, texCoordCount, std::string(materialLibrary), 0});
+        } else if (line.starts_with("v "))
+        {
+            vertexCount++;
+        } else if (line.starts_with("vt "))
+        {
+            texCoordCount++;
+        } else if (line.starts_with("mtllib "))
+        {
+            materialLibrary = line.substr(7);
+            if (materialLibrary.ends_with('\r')) { materialLibrary.remove_suffix(1); }
+        }
+        start = end + 1;
+    }
+    if (!blocks.empty()) { blocks.back().length = contents.size() - blocks.back().offset; }
+
+    for (ObjBlock& block : blocks)
+    {
+        block.hash = hashBytes(contents.substr(block.offset, block.length));
+    }
+    return blocks;
+}
+
+LiveScene::LiveScene(std::string filename) : _filename(filename), _snapshot(std::make_shared<const SceneSnapshot>())
+{
+#ifdef __linux__
+    // Watch the directory rather than the file: exporters often write a new file and rename it over the old one.
+    // Only finished files are reported: a file is still being written when it is created, so reading it then would see half of it.
+    _inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_inotify >= 0)
+    {
+        std::filesystem::path directory = std::filesystem::absolute(filename).parent_path();
+        _watch = inotify_add_watch(_inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    }
+#endif
+    reload();
+}
+
+LiveScene::~LiveScene()
+{
+#ifdef __linux__
+    if (_inotify >= 0) { close(_inotify); }
+#endif
+}
+
+size_t LiveScene::reload()
+{
+    PROFILE_SCOPE("reload");
+    std::string contents = readFile(_filename);
+    std::vector<ObjBlock> blocks = indexObjBlocks(contents);
+
+    // Objects whose name and records are the same as in the current snapshot are carried over as they are. Their face indices count
+    // from the start of the file, so the number of vertices and texture coordinates before them must match too.
+    std::shared_ptr<const SceneSnapshot> current = _snapshot.load();
+    auto next = std::make_shared<SceneSnapshot>(blocks.size());
+    std::vector<size_t> changed;
+    for (size_t b{0}; b < blocks.size(); ++b)
+    {
+        for (size_t old{0}; old < _blocks.size(); ++old)
+        {
+            const ObjBlock& previous = _blocks[old];
+            if (previous.name == blocks[b].name && previous.hash == blocks[b].hash && previous.vertexOffset == blocks[b].vertexOffset &&
+                previous.texCoordOffset == blocks[b].texCoordOffset && previous.materialLibrary == blocks[b].materialLibrary)
+            {
+                (*next)[b] = (*current)[old];
+                break;
+            }
+        }
+        if (!(*next)[b]) { changed.push_back(b); }
+    }
+
+    JobSystem::instance().parallelFor(changed.size(), 1, [&](size_t begin, size_t end)
+    {
+        for (size_t c{begin}; c < end; ++c)
+        {
+            const ObjBlock& block = blocks[changed[c]];
+            std::string materialLibrary = block.materialLibrary.empty() ? "" : resolvePath(block.materialLibrary, _filename);
+            auto object = std::make_shared<SceneObject>(block.name, std::string_view(contents).substr(block.offset, block.length), block.vertexOffset,
+                                                        block.texCoordOffset, materialLibrary);
+            object->buildLODs();
+            (*next)[changed[c]] = std::move(object);
+        }
+    });
+
+    _blocks = std::move(blocks);
+    _snapshot.store(std::move(next));
+    return changed.size();
+}
+
+bool LiveScene::waitForChange(int timeoutMs)
+{
+    std::string name = std::filesystem::path(_filename).filename().string();
+#ifdef __linux__
+    if (_watch >= 0)
+    {
+        pollfd fd{_inotify, POLLIN, 0};
+        while (poll(&fd, 1, timeoutMs) > 0)
+        {
+            // Drain every queued event, and report a change if any of them is about our file
+            alignas(inotify_event) char buffer[4096];
+            bool ours = false;
+            for (ssize_t length = read(_inotify, buffer, sizeof(buffer)); length > 0; length = read(_inotify, buffer, sizeof(buffer)))
+            {
+                for (char* p = buffer; p < buffer + length; p += sizeof(inotify_event) + ((inotify_event*)p)->len)
+                {
+                    const inotify_event* event = (const inotify_event*)p;
+                    if (event->len > 0 && name == event->name) { ours = true; }
+                }
+            }
+            if (ours) { return true; }
+        }
+        return false;
+    }
+#endif
+    // No inotify: poll the modification time
+    std::error_code error;
+    auto modified = std::filesystem::last_write_time(_filename, error);
+    for (int waited{0}; timeoutMs < 0 || waited < timeoutMs; waited += 50)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        if (std::filesystem::last_write_time(_filename, error) != modified) { return true; }
+    }
+    return false;
+}
@@ -0,0 +1,55 @@
+// The objects of an obj file, kept up to date while the file is edited (e.g. re-exported from Blender) without restarting.
+// The file is split into one block per "o" record, and each block's hash is kept. On a change, only the objects whose block changed
+// are parsed again; the others are shared with the previous version of the scene.
+//
+// Every version of the scene is an immutable snapshot. A reload builds the next one on the side and swaps it in with one atomic store,
+// so renders can keep reading the snapshot they started with while a reload runs.
+#pragma once
+
+#include "SceneObject.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using SceneSnapshot = std::vector<std::shared_ptr<const SceneObject>>;
+
+// Where one object's records sit in an obj file
+struct ObjBlock
+{
+    std::string name;
+    size_t offset, length;  // Records after the "o" line, up to the next object
+    int vertexOffset;       // Vertices declared before the object in the file
+    int texCoordOffset;     // Texture coordinates, likewise
+    std::string materialLibrary;    // As named by the last "mtllib" record before the object, empty if none
+    uint64_t hash;          // Of the object's records
+};
+
+// Blocks of every object of an obj file's contents, in file order
+std::vector<ObjBlock> indexObjBlocks(std::string_view contents);
+
+class LiveScene
+{
+public:
+    LiveScene(std::string filename = OBJ_FILE);
+    ~LiveScene();
+    LiveScene(const LiveScene&) = delete;
+    LiveScene& operator=(const LiveScene&) = delete;
+
+    std::shared_ptr<const SceneSnapshot> getObjects() const { return _snapshot.load(); }
+
+    // Read the file again and swap in a snapshot with the changed objects parsed (and their LODs built) again.
+    // Returns the number of objects that had to be parsed.
+    size_t reload();
+
+    // Wait up to timeoutMs (forever if negative) for the file to be written or replaced. Returns whether it was.
+    bool waitForChange(int timeoutMs = -1);
+
+private:
+    std::string _filename;
+    std::atomic<std::shared_ptr<const SceneSnapshot>> _snapshot;
+    std::vector<ObjBlock> _blocks;      // Index of the file the current snapshot was made from
+    int _inotify = -1, _watch = -1;
+};
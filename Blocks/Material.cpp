@@ -0,0 +1,128 @@
+#include "Material.h"
+#include "Profiler.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+std::string resolvePath(const std::string& name, const std::string& namedIn)
+{
+    std::filesystem::path path(name);
+    if (path.is_relative()) { path = std::filesystem::path(namedIn).parent_path() / path; }
+    return path.lexically_normal().string();
+}
+
+namespace
+{
+    MaterialLibrary loadLibrary(const std::string& filename)
+    {
+        PROFILE_SCOPE("material_library_load");
+        MaterialLibrary library;
+        std::shared_ptr<Material> material;
+        std::ifstream inFile(filename);
+        std::string line, keyword;
+        while (std::getline(inFile, line))
+        {
+            if (!line.empty() && line.back() == '\r') { line.pop_back(); }
+            std::istringstream iss{line};
+            if (!(iss >> keyword)) { continue; }
+            if (keyword == "newmtl")
+            {
+                material = std::make_shared<Material>();
+                std::getline(iss >> std::ws, material->name);
+                library[material->name] = material;
+            } else if (!material)
+            {
+                continue;
+            } else if (keyword == "Ka" || keyword == "Kd" || keyword == "Ks")
+            {
+                Vec3f& color = keyword == "Ka" ? material->ambient : keyword == "Kd" ? material->diffuse : material->specular;
+                iss >> color.x >> color.y >> color.z;
+            } else if (keyword == "Ns")
+            {
+                iss >> material->shininess;
+            } else if (keyword == "d")
+            {
+                iss >> material->opacity;
+            } else if (keyword == "Tr")
+            {
+                float transparency = 0;
+                iss >> transparency;
+                material->opacity = 1 - transparency;
+            } else if (keyword == "map_Kd")
+            {
+                // Options such as -s or -o come first, the file name last
+                std::string token, file;
+                while (iss >> token) { file = token; }
+                if (!file.empty()) { material->diffuseMap = MaterialCache::instance().getTexture(resolvePath(file, filename)); }
+            }
+        }
+        return library;
+    }
+}
+
+MaterialCache& MaterialCache::instance()
+{
+    static MaterialCache cache;
+    return cache;
+}
+
+// [comment]
+// The first thread to ask for a file puts a future in its place and loads it outside the lock, so loading one file doesn't hold up
+// requests for others, and a library can ask for its textures from inside its own load. Threads asking for the same file meanwhile
+// wait on the future instead of loading it again.
+// [/comment]
+template<typename T, typename Load>
+std::shared_ptr<const T> MaterialCache::get(Entries<T>& entries, const std::string& filename, Load load)
+{
+    std::promise<std::shared_ptr<const T>> promise;
+    std::shared_future<std::shared_ptr<const T>> future;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto found = entries.find(filename);
+        if (found != entries.end())
+        {
+            future = found->second;
+        } else
+        {
+            entries[filename] = promise.get_future().share();
+        }
+    }
+    if (future.valid()) { return future.get(); }
+
+    // A load that throws passes the exception to the threads waiting on it, and takes the entry out so the next to ask tries again
+    std::shared_ptr<const T> loaded;
+    try
+    {
+        loaded = load();
+    } catch (...)
+    {
+        promise.set_exception(std::current_exception());
+        std::lock_guard<std::mutex> lock(_mutex);
+        entries.erase(filename);
+        throw;
+    }
+    promise.set_value(loaded);
+    return loaded;
+}
+
+std::shared_ptr<const MaterialLibrary> MaterialCache::getLibrary(const std::string& filename)
+{
+    return get(_libraries, filename, [&]() { return std::make_shared<const MaterialLibrary>(loadLibrary(filename)); });
+}
+
+std::shared_ptr<const Texture> MaterialCache::getTexture(const std::string& filename)
+{
+    return get(_textures, filename, [&]() { return Texture::load(filename); });
+}
+
+size_t MaterialCache::getLibraryCount()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _libraries.size();
+}
+
+size_t MaterialCache::getTextureCount()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _textures.size();
+}
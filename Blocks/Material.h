@@ -0,0 +1,54 @@
+// Materials of MTL files (what an obj file's "mtllib" record names), and the cache that shares them and their textures.
+// Every library and every texture is read once, however many objects use it: objects hold shared pointers to the same Material,
+// and materials naming the same image file hold the same Texture.
+#pragma once
+
+#include "geometry.h"
+#include "Texture.h"
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+struct Material
+{
+    std::string name;
+    Vec3f ambient{0}, diffuse{0.8f}, specular{0};   // Ka, Kd and Ks
+    float shininess = 0;                            // Ns
+    float opacity = 1;                              // d, or 1 - Tr
+    std::shared_ptr<const Texture> diffuseMap;      // map_Kd, null if none or if it couldn't be read
+};
+
+// Every material of an MTL file, by name
+using MaterialLibrary = std::unordered_map<std::string, std::shared_ptr<const Material>>;
+
+// Path of a file named inside another file (a texture in an MTL file, an MTL file in an obj file), which is relative to the latter's directory
+std::string resolvePath(const std::string& name, const std::string& namedIn);
+
+class MaterialCache
+{
+public:
+    // The cache shared by the whole program
+    static MaterialCache& instance();
+
+    // Read on first use, by whichever thread asks first while any others asking wait for it. A missing file gives an empty library.
+    std::shared_ptr<const MaterialLibrary> getLibrary(const std::string& filename);
+    // Null if the file can't be read (see Texture::load)
+    std::shared_ptr<const Texture> getTexture(const std::string& filename);
+
+    // Files asked for so far, including any that couldn't be read
+    size_t getLibraryCount();
+    size_t getTextureCount();
+
+private:
+    template<typename T>
+    using Entries = std::unordered_map<std::string, std::shared_future<std::shared_ptr<const T>>>;
+
+    template<typename T, typename Load>
+    std::shared_ptr<const T> get(Entries<T>& entries, const std::string& filename, Load load);
+
+    std::mutex _mutex;
+    Entries<MaterialLibrary> _libraries;
+    Entries<Texture> _textures;
+};
@@ -0,0 +1,185 @@
+#include "MatrixBatch.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <iostream>
+
+void Matrix44Batch::resize(size_t count)
+{
+    // Capacity at least doubles when it grows, so matrices can be added one at a time
+    if (count > _capacity)
+    {
+        size_t capacity = (std::max(count, 2 * _capacity) + LANES - 1) / LANES * LANES;
+        std::vector<float> elements(16 * capacity);
+        for (int e{0}; e < 16; ++e)
+        {
+            std::copy(_elements.data() + e * _capacity, _elements.data() + e * _capacity + _count, elements.data() + e * capacity);
+        }
+        _elements.swap(elements);
+        _capacity = capacity;
+    }
+    for (int e{0}; e < 16; ++e)
+    {
+        float* elements = _elements.data() + e * _capacity;
+        std::fill(elements + std::min(_count, count), elements + count, e % 5 == 0 ? 1.0f : 0.0f);  // Diagonal elements are 0, 5, 10 and 15
+    }
+    _count = count;
+}
+
+void Matrix44Batch::push_back(const Matrix44f& m)
+{
+    resize(_count + 1);
+    set(_count - 1, m);
+}
+
+void Matrix44Batch::set(size_t i, const Matrix44f& m)
+{
+    for (int e{0}; e < 16; ++e) { _elements[e * _capacity + i] = m[e / 4][e % 4]; }
+}
+
+Matrix44f Matrix44Batch::get(size_t i) const
+{
+    Matrix44f m;
+    for (int e{0}; e < 16; ++e) { m[e / 4][e % 4] = _elements[e * _capacity + i]; }
+    return m;
+}
+
+// The kernels go through the matrices LANES at a time with the arrays as restrict pointers (a promise that they don't overlap) or
+// copied into local arrays, which the compiler vectorizes even at -O2, where it won't vectorize a loop that needs a scalar remainder.
+// Capacity is a multiple of LANES, so the last group can run past the count into padding. Sums are in the same order as
+// Matrix44::multiply, so results are identical.
+namespace
+{
+    constexpr size_t LANES = Matrix44Batch::LANES;
+
+    // Matrices multiplied at a time: every element of a block of inputs and outputs (32 arrays of 256 floats) stays in L1 while
+    // the 16 output elements are computed, instead of streaming the whole batch from memory 16 times
+    constexpr size_t BLOCK = 256;
+
+    // Matrices the kernels go through for count matrices: the count up to the next multiple of LANES, which every batch of count
+    // matrices has capacity for. Not the capacity itself, which a batch reused for a smaller count keeps and its inputs may not have.
+    size_t paddedCount(size_t count) { return (count + LANES - 1) / LANES * LANES; }
+
+    // o = a0 * b0 + a1 * b1 + a2 * b2 + a3 * b3, element by element
+    void combine(const float* __restrict a0, const float* __restrict a1, const float* __restrict a2, const float* __restrict a3,
+                 const float* __restrict b0, const float* __restrict b1, const float* __restrict b2, const float* __restrict b3,
+                 float* __restrict o, size_t count)
+    {
+        for (size_t i{0}; i < count; i += LANES)
+        {
+            for (size_t lane{0}; lane < LANES; ++lane)
+            {
+                o[i + lane] = a0[i + lane] * b0[i + lane] + a1[i + lane] * b1[i + lane] + a2[i + lane] * b2[i + lane] + a3[i + lane] * b3[i + lane];
+            }
+        }
+    }
+
+    // o = a0 * b0 + a1 * b1 + a2 * b2 + a3 * b3, with the same b for every element
+    void combine(const float* __restrict a0, const float* __restrict a1, const float* __restrict a2, const float* __restrict a3,
+                 float b0, float b1, float b2, float b3, float* __restrict o, size_t count)
+    {
+        for (size_t i{0}; i < count; i += LANES)
+        {
+            for (size_t lane{0}; lane < LANES; ++lane)
+            {
+                o[i + lane] = a0[i + lane] * b0 + a1[i + lane] * b1 + a2[i + lane] * b2 + a3[i + lane] * b3;
+            }
+        }
+    }
+}
+
+void Matrix44Batch::multiply(const Matrix44Batch& a, const Matrix44Batch& b, Matrix44Batch& out)
+{
+    PROFILE_SCOPE("matrix_batch_multiply");
+    if (b._count != a._count)
+    {
+        std::cerr << "Matrix44Batch::multiply: batches of " << a._count << " and " << b._count << " matrices" << '\n';
+        out.resize(0);
+        return;
+    }
+    out.resize(a._count);
+    size_t padded = paddedCount(a._count);
+    for (size_t i{0}; i < padded; i += BLOCK)
+    {
+        size_t count = std::min(BLOCK, padded - i);
+        for (int r{0}; r < 4; ++r)
+        {
+            for (int c{0}; c < 4; ++c)
+            {
+                combine(a.element(r, 0) + i, a.element(r, 1) + i, a.element(r, 2) + i, a.element(r, 3) + i,
+                        b.element(0, c) + i, b.element(1, c) + i, b.element(2, c) + i, b.element(3, c) + i, out.element(r, c) + i, count);
+            }
+        }
+    }
+}
+
+void Matrix44Batch::multiply(const Matrix44Batch& a, const Matrix44f& b, Matrix44Batch& out)
+{
+    PROFILE_SCOPE("matrix_batch_multiply");
+    out.resize(a._count);
+    size_t padded = paddedCount(a._count);
+    for (size_t i{0}; i < padded; i += BLOCK)
+    {
+        size_t count = std::min(BLOCK, padded - i);
+        for (int r{0}; r < 4; ++r)
+        {
+            for (int c{0}; c < 4; ++c)
+            {
+                combine(a.element(r, 0) + i, a.element(r, 1) + i, a.element(r, 2) + i, a.element(r, 3) + i,
+                        b[0][c], b[1][c], b[2][c], b[3][c], out.element(r, c) + i, count);
+            }
+        }
+    }
+}
+
+void Matrix44Batch::affineInverse(const Matrix44Batch& a, Matrix44Batch& out)
+{
+    PROFILE_SCOPE("matrix_batch_inverse");
+    out.resize(a._count);
+    for (size_t i{0}; i < a._count; i += LANES)
+    {
+        // The 3x3 part and the translation of LANES matrices, element by element
+        float m[4][3][LANES], inv[4][3][LANES];
+        for (int r{0}; r < 4; ++r)
+        {
+            for (int c{0}; c < 3; ++c) { std::copy(a.element(r, c) + i, a.element(r, c) + i + LANES, m[r][c]); }
+        }
+
+        for (size_t l{0}; l < LANES; ++l)
+        {
+            // Cofactors of the first row give the determinant
+            float c00 = m[1][1][l] * m[2][2][l] - m[1][2][l] * m[2][1][l];
+            float c01 = m[1][2][l] * m[2][0][l] - m[1][0][l] * m[2][2][l];
+            float c02 = m[1][0][l] * m[2][1][l] - m[1][1][l] * m[2][0][l];
+            float det = m[0][0][l] * c00 + m[0][1][l] * c01 + m[0][2][l] * c02;
+            // 1 / det, or 0 for a singular matrix, written without a branch or a select so the loop stays vectorized
+            float nonSingular = (float)(det != 0);
+            float invDet = nonSingular / (det + (1 - nonSingular));
+
+            inv[0][0][l] = c00 * invDet;
+            inv[0][1][l] = (m[0][2][l] * m[2][1][l] - m[0][1][l] * m[2][2][l]) * invDet;
+            inv[0][2][l] = (m[0][1][l] * m[1][2][l] - m[0][2][l] * m[1][1][l]) * invDet;
+            inv[1][0][l] = c01 * invDet;
+            inv[1][1][l] = (m[0][0][l] * m[2][2][l] - m[0][2][l] * m[2][0][l]) * invDet;
+            inv[1][2][l] = (m[0][2][l] * m[1][0][l] - m[0][0][l] * m[1][2][l]) * invDet;
+            inv[2][0][l] = c02 * invDet;
+            inv[2][1][l] = (m[0][1][l] * m[2][0][l] - m[0][0][l] * m[2][1][l]) * invDet;
+            inv[2][2][l] = (m[0][0][l] * m[1][1][l] - m[0][1][l] * m[1][0][l]) * invDet;
+
+            // A point p maps to p * M + t, so the inverse maps q to (q - t) * M^-1
+            inv[3][0][l] = -(m[3][0][l] * inv[0][0][l] + m[3][1][l] * inv[1][0][l] + m[3][2][l] * inv[2][0][l]);
+            inv[3][1][l] = -(m[3][0][l] * inv[0][1][l] + m[3][1][l] * inv[1][1][l] + m[3][2][l] * inv[2][1][l]);
+            inv[3][2][l] = -(m[3][0][l] * inv[0][2][l] + m[3][1][l] * inv[1][2][l] + m[3][2][l] * inv[2][2][l]);
+        }
+
+        for (int r{0}; r < 4; ++r)
+        {
+            for (int c{0}; c < 3; ++c) { std::copy(inv[r][c], inv[r][c] + LANES, out.element(r, c) + i); }
+        }
+    }
+
+    // Last column of an affine matrix's inverse is the same as its own
+    for (int r{0}; r < 4; ++r)
+    {
+        std::fill(out.element(r, 3), out.element(r, 3) + a._count, r == 3 ? 1.0f : 0.0f);
+    }
+}
@@ -0,0 +1,44 @@
+// Many 4x4 matrices stored as structure of arrays: element [r][c] of every matrix is one contiguous array. A batch operation then walks
+// those arrays in lockstep, doing the same arithmetic for matrix i, i+1, ... side by side, which the compiler turns into SIMD code
+// (several matrices per instruction) instead of the shuffling one matrix at a time needs.
+// Matrices follow geometry.h's conventions: points are row vectors, so a * b applies a first.
+#pragma once
+
+#include "geometry.h"
+#include <cstddef>
+#include <vector>
+
+class Matrix44Batch
+{
+public:
+    static constexpr size_t LANES = 8;      // Matrices per step of the kernels. Capacity is always a multiple of it.
+
+    Matrix44Batch(size_t count = 0) { resize(count); }
+
+    size_t size() const { return _count; }
+
+    // New matrices are identities, existing ones are kept
+    void resize(size_t count);
+    void push_back(const Matrix44f& m);
+
+    void set(size_t i, const Matrix44f& m);
+    Matrix44f get(size_t i) const;
+
+    // Element [row][column] of every matrix
+    float* element(int row, int column) { return _elements.data() + (row * 4 + column) * _capacity; }
+    const float* element(int row, int column) const { return _elements.data() + (row * 4 + column) * _capacity; }
+
+    // out[i] = a[i] * b[i]. out may not be a or b. Batches of different sizes are rejected with a message, leaving out empty.
+    static void multiply(const Matrix44Batch& a, const Matrix44Batch& b, Matrix44Batch& out);
+
+    // out[i] = a[i] * b, e.g. every object's transform composed with the world to camera transform. out may not be a.
+    static void multiply(const Matrix44Batch& a, const Matrix44f& b, Matrix44Batch& out);
+
+    // Inverse of every matrix, each of which must be affine (last column 0, 0, 0, 1): the 3x3 part is inverted by cofactors and the
+    // translation is undone through it. A singular matrix gets zeros in place of its inverse. out may not be a.
+    static void affineInverse(const Matrix44Batch& a, Matrix44Batch& out);
+
+private:
+    size_t _count = 0, _capacity = 0;
+    std::vector<float> _elements;   // 16 arrays of _capacity floats, in row major element order, of which the first _count are used
+};
@@ -0,0 +1,98 @@
+#include "Morton.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+// Spread the low 10 bits of x so there are two zero bits between each of them
+static uint32_t expandBits(uint32_t x)
+{
+    x &= 0x3ff;
+    x = (x | (x << 16)) & 0x030000ff;
+    x = (x | (x << 8)) & 0x0300f00f;
+    x = (x | (x << 4)) & 0x030c30c3;
+    x = (x | (x << 2)) & 0x09249249;
+    return x;
+}
+
+uint32_t mortonCode(const Vec3f& p, const Vec3f& min, const Vec3f& max)
+{
+    // Quantize each axis to [0, 1023]. A flat box (e.g. the floor) leaves that axis at 0.
+    auto quantize = [](float v, float lo, float hi)
+    {
+        if (hi <= lo) { return 0u; }
+        return (uint32_t)std::clamp((v - lo) / (hi - lo) * 1023.0f, 0.0f, 1023.0f);
+    };
+    return expandBits(quantize(p.x, min.x, max.x)) | expandBits(quantize(p.y, min.y, max.y)) << 1 | expandBits(quantize(p.z, min.z, max.z)) << 2;
+}
+
+static void computeBounds(const std::vector<Vec3f>& points, Vec3f& min, Vec3f& max)
+{
+    min = Vec3f(std::numeric_limits<float>::max());
+    max = Vec3f(std::numeric_limits<float>::lowest());
+    for (const Vec3f& p : points)
+    {
+        min = Vec3f(std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z));
+        max = Vec3f(std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z));
+    }
+}
+
+void sortVerticesMorton(std::vector<Vec3f>& vertices, std::vector<int>& triangles)
+{
+    PROFILE_SCOPE("morton_sort");
+    Vec3f min, max;
+    computeBounds(vertices, min, max);
+
+    std::vector<uint32_t> codes(vertices.size());
+    for (size_t v{0}; v < vertices.size(); ++v)
+    {
+        codes[v] = mortonCode(vertices[v], min, max);
+    }
+
+    // Stable, so vertices sharing a cell keep their current order
+    std::vector<int> order(vertices.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return codes[a] < codes[b]; });
+
+    std::vector<int> newIndex(vertices.size());
+    std::vector<Vec3f> sorted(vertices.size());
+    for (size_t v{0}; v < order.size(); ++v)
+    {
+        newIndex[order[v]] = (int)v;
+        sorted[v] = vertices[order[v]];
+    }
+    vertices = std::move(sorted);
+    for (int& index : triangles)
+    {
+        index = newIndex[index];
+    }
+}
+
+void sortObjectsMorton(std::vector<SceneObject>& objects)
+{
+    PROFILE_SCOPE("morton_sort");
+    std::vector<Vec3f> centers;
+    for (const SceneObject& object : objects)
+    {
+        Vec3f min, max;
+        computeBounds(object.getVertices(), min, max);
+        centers.push_back((min + max) * 0.5f);
+    }
+    Vec3f min, max;
+    computeBounds(centers, min, max);
+
+    std::vector<std::pair<uint32_t, size_t>> keys;
+    for (size_t o{0}; o < objects.size(); ++o)
+    {
+        keys.emplace_back(mortonCode(centers[o], min, max), o);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<SceneObject> sorted;
+    sorted.reserve(objects.size());
+    for (const auto& key : keys)
+    {
+        sorted.push_back(std::move(objects[key.second]));
+    }
+    objects = std::move(sorted);
+}
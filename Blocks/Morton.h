@@ -0,0 +1,18 @@
+// Z-order (Morton) curve sorting. Points close together in space get close Morton codes, so storing things in code order keeps
+// neighbours close together in memory: a tile of the image or a cell of the frustum then reads one contiguous run instead of
+// picking entries from all over the file order.
+#pragma once
+
+#include "geometry.h"
+#include "SceneObject.h"
+#include <cstdint>
+#include <vector>
+
+// Position along the curve of a point in the box [min, max], with 10 bits per axis interleaved as ...zyxzyx
+uint32_t mortonCode(const Vec3f& p, const Vec3f& min, const Vec3f& max);
+
+// Reorder vertices along the curve through their bounding box, remapping the indices so the triangles (and their order) are unchanged
+void sortVerticesMorton(std::vector<Vec3f>& vertices, std::vector<int>& triangles);
+
+// Reorder objects along the curve through the scene's bounding box, by the centre of each object's bounding box
+void sortObjectsMorton(std::vector<SceneObject>& objects);
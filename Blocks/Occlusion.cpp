@@ -0,0 +1,224 @@
+#include "Occlusion.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+void BoxBatch::resize(size_t count)
+{
+    // Capacity at least doubles when it grows, so boxes can be added one at a time
+    if (count > _capacity)
+    {
+        size_t capacity = (std::max(count, 2 * _capacity) + LANES - 1) / LANES * LANES;
+        std::vector<float> coordinates(6 * capacity);
+        for (int a{0}; a < 6; ++a)
+        {
+            std::copy(_coordinates.data() + a * _capacity, _coordinates.data() + a * _capacity + _count, coordinates.data() + a * capacity);
+        }
+        _coordinates.swap(coordinates);
+        _capacity = capacity;
+    }
+    _count = count;
+}
+
+void BoxBatch::set(size_t i, const Vec3f& min, const Vec3f& max)
+{
+    for (int a{0}; a < 3; ++a)
+    {
+        _coordinates[a * _capacity + i] = min[a];
+        _coordinates[(3 + a) * _capacity + i] = max[a];
+    }
+}
+
+static constexpr float INFINITE_DEPTH = std::numeric_limits<float>::infinity();
+
+OcclusionBuffer::OcclusionBuffer(uint32_t imageWidth, uint32_t imageHeight)
+{
+    _scale = (float)RESOLUTION / std::max({imageWidth, imageHeight, 1u});
+    uint32_t width = std::max(1u, (uint32_t)std::ceil(imageWidth * _scale)), height = std::max(1u, (uint32_t)std::ceil(imageHeight * _scale));
+    while (true)
+    {
+        _levels.push_back({width, height, std::vector<float>((size_t)width * height, INFINITE_DEPTH)});
+        if (width == 1 && height == 1) { break; }
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+}
+
+void OcclusionBuffer::clear(const Matrix44f& worldToRaster, float nearClippingPlane)
+{
+    Matrix44f rasterToBuffer
+    {
+        _scale, 0, 0, 0,
+        0, _scale, 0, 0,
+        0, 0, 1, 0,
+        0, 0, 0, 1
+    };
+    _worldToBuffer = worldToRaster * rasterToBuffer;
+    _near = nearClippingPlane;
+    for (Level& level : _levels)
+    {
+        std::fill(level.depths.begin(), level.depths.end(), INFINITE_DEPTH);
+    }
+}
+
+// [comment]
+// The boxes go through LANES at a time, copied into local arrays as in Matrix44Batch::affineInverse, so that the loop over lanes is
+// vectorized: each of the 8 corners is projected for every lane at once, and the lanes' extents grow with min and max, without a branch.
+// Capacity is a multiple of LANES, so the last group runs past the count into padding, whose results are dropped.
+// [/comment]
+void OcclusionBuffer::project(const BoxBatch& boxes, std::vector<ScreenBox>& out) const
+{
+    PROFILE_SCOPE("occlusion_project_boxes");
+    constexpr size_t LANES = BoxBatch::LANES;
+    const Matrix44f& m = _worldToBuffer;
+    float m00 = m[0][0], m10 = m[1][0], m20 = m[2][0], m30 = m[3][0];
+    float m01 = m[0][1], m11 = m[1][1], m21 = m[2][1], m31 = m[3][1];
+    float m03 = m[0][3], m13 = m[1][3], m23 = m[2][3], m33 = m[3][3];
+
+    out.resize(boxes.size());
+    for (size_t i{0}; i < boxes.size(); i += LANES)
+    {
+        float left[LANES], top[LANES], right[LANES], bottom[LANES], nearest[LANES];
+        std::fill(left, left + LANES, INFINITE_DEPTH);
+        std::fill(top, top + LANES, INFINITE_DEPTH);
+        std::fill(right, right + LANES, -INFINITE_DEPTH);
+        std::fill(bottom, bottom + LANES, -INFINITE_DEPTH);
+        std::fill(nearest, nearest + LANES, INFINITE_DEPTH);
+
+        for (int corner{0}; corner < 8; ++corner)
+        {
+            const float* xs = (corner & 1 ? boxes.max(0) : boxes.min(0)) + i;
+            const float* ys = (corner & 2 ? boxes.max(1) : boxes.min(1)) + i;
+            const float* zs = (corner & 4 ? boxes.max(2) : boxes.min(2)) + i;
+            for (size_t l{0}; l < LANES; ++l)
+            {
+                float x = xs[l] * m00 + ys[l] * m10 + zs[l] * m20 + m30;
+                float y = xs[l] * m01 + ys[l] * m11 + zs[l] * m21 + m31;
+                float w = xs[l] * m03 + ys[l] * m13 + zs[l] * m23 + m33;
+                // A corner behind the camera projects to nonsense, but then nearest is below the near plane and the box isn't tested
+                float invW = 1 / w;
+                left[l] = std::min(left[l], x * invW);
+                right[l] = std::max(right[l], x * invW);
+                top[l] = std::min(top[l], y * invW);
+                bottom[l] = std::max(bottom[l], y * invW);
+                nearest[l] = std::min(nearest[l], w);
+            }
+        }
+
+        for (size_t l{0}; l < LANES && i + l < boxes.size(); ++l)
+        {
+            out[i + l] = {left[l], top[l], right[l], bottom[l], nearest[l]};
+        }
+    }
+}
+
+// [comment]
+// Pixels are sampled at their centres, and a covered pixel takes the farthest depth of the triangle rather than an interpolated one,
+// which can only make the occluder look farther away than it is. Both sides of a triangle are drawn, as open meshes (a floor) occlude too.
+// [/comment]
+void OcclusionBuffer::drawOccluder(const std::vector<Vec3f>& vertices, const std::vector<int>& triangles)
+{
+    PROFILE_SCOPE("occlusion_draw_occluder");
+    Level& level = _levels[0];
+    for (size_t t{0}; t < triangles.size() / 3; ++t)
+    {
+        Vec3f p[3];
+        float farthest = 0;
+        bool clipped = false;
+        for (int k{0}; k < 3; ++k)
+        {
+            const Vec3f& v = vertices[triangles[t * 3 + k]];
+            const Matrix44f& m = _worldToBuffer;
+            float w = v.x * m[0][3] + v.y * m[1][3] + v.z * m[2][3] + m[3][3];
+            float x = v.x * m[0][0] + v.y * m[1][0] + v.z * m[2][0] + m[3][0];
+            float y = v.x * m[0][1] + v.y * m[1][1] + v.z * m[2][1] + m[3][1];
+            clipped |= w < _near;
+            p[k] = Vec3f(x / w, y / w, w);
+            farthest = std::max(farthest, w);
+        }
+        if (clipped) { continue; }
+
+        // Edge functions, oriented so the inside is positive whichever way the triangle winds
+        float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+        if (area == 0) { continue; }
+        if (area < 0) { std::swap(p[1], p[2]); }
+
+        // Pixels whose centres fall in the triangle's bounds, clamped in floating point first so a far off corner can't overflow an int
+        float width = (float)level.width, height = (float)level.height;
+        int x0 = (int)std::ceil(std::clamp(std::min({p[0].x, p[1].x, p[2].x}) - 0.5f, 0.0f, width));
+        int x1 = (int)std::floor(std::clamp(std::max({p[0].x, p[1].x, p[2].x}) - 0.5f, -1.0f, width - 1));
+        int y0 = (int)std::ceil(std::clamp(std::min({p[0].y, p[1].y, p[2].y}) - 0.5f, 0.0f, height));
+        int y1 = (int)std::floor(std::clamp(std::max({p[0].y, p[1].y, p[2].y}) - 0.5f, -1.0f, height - 1));
+        for (int y{y0}; y <= y1; ++y)
+        {
+            float cy = y + 0.5f;
+            for (int x{x0}; x <= x1; ++x)
+            {
+                float cx = x + 0.5f;
+                bool inside = true;
+                for (int e{0}; e < 3; ++e)
+                {
+                    const Vec3f& a = p[e], &b = p[(e + 1) % 3];
+                    inside &= (b.x - a.x) * (cy - a.y) - (b.y - a.y) * (cx - a.x) >= 0;
+                }
+                float& depth = level.depths[(size_t)y * level.width + x];
+                if (inside) { depth = std::min(depth, farthest); }
+            }
+        }
+    }
+}
+
+void OcclusionBuffer::buildHierarchy()
+{
+    PROFILE_SCOPE("occlusion_build_hierarchy");
+    for (size_t l{1}; l < _levels.size(); ++l)
+    {
+        const Level& below = _levels[l - 1];
+        Level& level = _levels[l];
+        for (uint32_t y{0}; y < level.height; ++y)
+        {
+            for (uint32_t x{0}; x < level.width; ++x)
+            {
+                // Texels on the right or bottom edge of an odd sized level have fewer than 4 below them
+                float farthest = 0;
+                for (uint32_t by{2 * y}; by < std::min(2 * y + 2, below.height); ++by)
+                {
+                    for (uint32_t bx{2 * x}; bx < std::min(2 * x + 2, below.width); ++bx)
+                    {
+                        farthest = std::max(farthest, below.depths[(size_t)by * below.width + bx]);
+                    }
+                }
+                level.depths[(size_t)y * level.width + x] = farthest;
+            }
+        }
+    }
+}
+
+// [comment]
+// A pixel only counts as covered when its centre is, so the box's rectangle is grown by a pixel on every side: if the centres of all
+// the pixels around it are covered by a convex occluder, so is everything between them. Only the part of the rectangle inside the
+// image has to be hidden. A box wholly outside it is left to the renderer, which draws what lies outside the frame in red.
+// [/comment]
+bool OcclusionBuffer::isOccluded(const ScreenBox& box) const
+{
+    float width = (float)getWidth(), height = (float)getHeight();
+    if (!(box.nearest >= _near)) { return false; }
+    if (box.right < 0 || box.bottom < 0 || box.left >= width || box.top >= height) { return false; }
+    int x0 = std::max(0, (int)std::floor(std::max(box.left, 0.0f)) - 1), x1 = std::min((int)getWidth() - 1, (int)std::floor(std::min(box.right, width)) + 1);
+    int y0 = std::max(0, (int)std::floor(std::max(box.top, 0.0f)) - 1), y1 = std::min((int)getHeight() - 1, (int)std::floor(std::min(box.bottom, height)) + 1);
+
+    // The finest level where the rectangle spans at most 4x4 texels
+    size_t l = 0;
+    while ((x1 >> l) - (x0 >> l) >= 4 || (y1 >> l) - (y0 >> l) >= 4) { ++l; }
+    const Level& level = _levels[l];
+    PROFILE_COUNT("occlusion_texels_tested", ((x1 >> l) - (x0 >> l) + 1) * ((y1 >> l) - (y0 >> l) + 1));
+    for (int y{y0 >> l}; y <= y1 >> l; ++y)
+    {
+        for (int x{x0 >> l}; x <= x1 >> l; ++x)
+        {
+            if (level.depths[(size_t)y * level.width + x] >= box.nearest) { return false; }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,79 @@
+// Software occlusion culling. A few large occluders are rasterized into a small depth buffer, and every object's bounding box is then
+// tested against it: an object whose box lies wholly behind what is already drawn there is skipped without projecting any of its triangles.
+//
+// The buffer stores, per pixel, the distance in front of the camera of the nearest occluder, and is summarized into a hierarchy where each
+// texel holds the farthest of the 2x2 texels below it. A box is tested at the level where its screen rectangle covers at most 4x4 texels,
+// so the test costs the same whatever the box's size. Boxes are projected LANES at a time from structure of arrays, as Matrix44Batch does.
+//
+// Everything errs towards drawing: occluders only write the farthest depth of each triangle, triangles crossing the near plane are
+// left out, and a box crossing the near plane is always drawn.
+#pragma once
+
+#include "geometry.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Axis aligned boxes as structure of arrays: the minimum x of every box is one contiguous array, and so on
+class BoxBatch
+{
+public:
+    static constexpr size_t LANES = 8;      // Boxes per step of OcclusionBuffer::project. Capacity is always a multiple of it.
+
+    BoxBatch(size_t count = 0) { resize(count); }
+
+    size_t size() const { return _count; }
+    void resize(size_t count);
+    void set(size_t i, const Vec3f& min, const Vec3f& max);
+
+    // Coordinate axis (0, 1 or 2) of every box's minimum or maximum corner
+    const float* min(int axis) const { return _coordinates.data() + axis * _capacity; }
+    const float* max(int axis) const { return _coordinates.data() + (3 + axis) * _capacity; }
+
+private:
+    size_t _count = 0, _capacity = 0;
+    std::vector<float> _coordinates;    // 6 arrays of _capacity floats: min x, y, z then max x, y, z
+};
+
+// Where a box lands in the occlusion buffer, in its pixels
+struct ScreenBox
+{
+    float left, top, right, bottom;
+    float nearest;      // Smallest distance in front of the camera of any corner. Below the near plane the box can't be tested.
+};
+
+class OcclusionBuffer
+{
+public:
+    static constexpr uint32_t RESOLUTION = 128;     // Pixels along the longer side of the image
+
+    OcclusionBuffer(uint32_t imageWidth, uint32_t imageHeight);
+
+    // Start over for a camera. worldToRaster is the camera's inverse and its projection together (see Camera::getProjection).
+    void clear(const Matrix44f& worldToRaster, float nearClippingPlane);
+
+    // Screen box of every box of the batch, whose corners are in world space
+    void project(const BoxBatch& boxes, std::vector<ScreenBox>& out) const;
+
+    // Rasterize an object's triangles, whose vertices are in world space. Draw every occluder before building the hierarchy.
+    void drawOccluder(const std::vector<Vec3f>& vertices, const std::vector<int>& triangles);
+    void buildHierarchy();
+
+    // Whether everything inside the box is farther than the occluders drawn over it
+    bool isOccluded(const ScreenBox& box) const;
+
+    uint32_t getWidth() const { return _levels[0].width; }
+    uint32_t getHeight() const { return _levels[0].height; }
+
+private:
+    struct Level
+    {
+        uint32_t width, height;
+        std::vector<float> depths;  // Rows top to bottom. Infinity where nothing is drawn.
+    };
+
+    Matrix44f _worldToBuffer;       // World space to homogeneous buffer pixels, w being the distance in front of the camera
+    float _scale;                   // Buffer pixels per image pixel
+    float _near = 0;
+    std::vector<Level> _levels;     // Full resolution first, then halved until 1x1
+};
@@ -0,0 +1,154 @@
+// Scoped timers and counters for finding where the time of a run goes, dumped as a JSON report at the end.
+// Only compiled in when building with -DENABLE_PROFILING, otherwise every macro expands to nothing and costs nothing.
+//
+//     PROFILE_SCOPE("projection");             // Time from here to the end of the enclosing block
+//     PROFILE_COUNT("triangles_emitted", 1);   // Add to a counter
+//     PROFILE_REPORT("profile.json");          // Write everything recorded so far
+//
+// Each thread records into its own buffer, so timers never contend on a lock. A thread's buffer is merged into the totals when the
+// thread exits, which means a report only includes threads that have finished (and the thread writing it).
+#pragma once
+
+#ifdef ENABLE_PROFILING
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+namespace profiling
+{
+    constexpr int MAX_ENTRIES = 64;
+
+    struct Entry
+    {
+        uint64_t calls = 0;         // Number of times a timer ran, or the value of a counter
+        uint64_t nanoseconds = 0;   // Total time, timers only
+    };
+
+    struct ThreadBuffer
+    {
+        Entry entries[MAX_ENTRIES];
+        ~ThreadBuffer();
+    };
+
+    inline thread_local ThreadBuffer buffer;
+
+    class Profiler
+    {
+    public:
+        static Profiler& instance()
+        {
+            static Profiler profiler;
+            return profiler;
+        }
+
+        // Index of the entry for a name, registered the first time it is seen. Call sites cache it in a static.
+        int slot(const char* name, bool timer)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (int i{0}; i < _count; ++i)
+            {
+                if (std::strcmp(_names[i], name) == 0) { return i; }
+            }
+            if (_count == MAX_ENTRIES) { return MAX_ENTRIES - 1; }
+            _names[_count] = name;
+            _timers[_count] = timer;
+            return _count++;
+        }
+
+        void merge(const ThreadBuffer& thread)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (int i{0}; i < MAX_ENTRIES; ++i)
+            {
+                _totals[i].calls += thread.entries[i].calls;
+                _totals[i].nanoseconds += thread.entries[i].nanoseconds;
+            }
+        }
+
+        bool writeReport(const std::string& filename)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            std::ofstream ofs(filename);
+            if (!ofs.is_open()) { return false; }
+
+            auto write = [&](bool timers)
+            {
+                bool first = true;
+                for (int i{0}; i < _count; ++i)
+                {
+                    if (_timers[i] != timers) { continue; }
+                    uint64_t calls = _totals[i].calls + buffer.entries[i].calls;
+                    uint64_t nanoseconds = _totals[i].nanoseconds + buffer.entries[i].nanoseconds;
+
+                    ofs << (first ? "\n" : ",\n") << "    \"" << _names[i] << "\": ";
+                    if (timers)
+                    {
+                        ofs << "{\"calls\": " << calls << ", \"total_ms\": " << nanoseconds / 1e6
+                            << ", \"mean_us\": " << (calls ? nanoseconds / 1e3 / calls : 0) << "}";
+                    } else
+                    {
+                        ofs << calls;
+                    }
+                    first = false;
+                }
+                ofs << "\n  }";
+            };
+
+            ofs << "{\n  \"timers\": {";
+            write(true);
+            ofs << ",\n  \"counters\": {";
+            write(false);
+            ofs << "\n}\n";
+            return true;
+        }
+
+    private:
+        std::mutex _mutex;
+        const char* _names[MAX_ENTRIES] = {};
+        bool _timers[MAX_ENTRIES] = {};
+        Entry _totals[MAX_ENTRIES];
+        int _count = 0;
+    };
+
+    inline ThreadBuffer::~ThreadBuffer()
+    {
+        Profiler::instance().merge(*this);
+    }
+
+    class ScopedTimer
+    {
+    public:
+        ScopedTimer(int slot) : _slot(slot), _start(std::chrono::steady_clock::now()) {}
+        ~ScopedTimer()
+        {
+            Entry& entry = buffer.entries[_slot];
+            entry.calls++;
+            entry.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start).count();
+        }
+
+    private:
+        int _slot;
+        std::chrono::steady_clock::time_point _start;
+    };
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) \
+    static const int PROFILE_CONCAT(profileSlot, __LINE__) = profiling::Profiler::instance().slot(name, true); \
+    profiling::ScopedTimer PROFILE_CONCAT(profileTimer, __LINE__)(PROFILE_CONCAT(profileSlot, __LINE__))
+#define PROFILE_COUNT(name, n) \
+    do { static const int slot = profiling::Profiler::instance().slot(name, false); profiling::buffer.entries[slot].calls += (n); } while (0)
+#define PROFILE_REPORT(filename) profiling::Profiler::instance().writeReport(filename)
+
+#else
+
+#define PROFILE_SCOPE(name) do {} while (0)
+#define PROFILE_COUNT(name, n) do {} while (0)
+#define PROFILE_REPORT(filename) do {} while (0)
+
+#endif
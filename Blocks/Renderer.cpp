@@ -0,0 +1,295 @@
+#include "Renderer.h"
+#include "Profiler.h"
+#include "JobSystem.h"
+#include "Occlusion.h"
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <sstream>
+
+// [comment]
+// Same pinhole projection as the headphones renderer, with the camera, perspective and viewport concatenated into objectToRaster.
+// Computes the raster coordinates of a point, returning whether that point lies inside the image.
+// [/comment]
+static bool computeCoordinates(const Vec3f &p, const Matrix44f &objectToRaster, float imageWidth, float imageHeight, Vec2i &pRaster)
+{
+    const Matrix44f &m = objectToRaster;
+    float x = p.x * m[0][0] + p.y * m[1][0] + p.z * m[2][0] + m[3][0];
+    float y = p.x * m[0][1] + p.y * m[1][1] + p.z * m[2][1] + m[3][1];
+    float w = p.x * m[0][3] + p.y * m[1][3] + p.z * m[2][3] + m[3][3];
+
+    // One reciprocal per point
+    float invW = 1 / w;
+    x *= invW;
+    y *= invW;
+    pRaster.x = (int)x;
+    pRaster.y = (int)y;
+
+    return x >= 0 && x <= imageWidth && y >= 0 && y <= imageHeight;
+}
+
+// Image the camera projects onto
+struct Canvas
+{
+    Matrix44f projection;
+    uint32_t imageWidth, imageHeight;
+};
+
+static Canvas makeCanvas(const Camera& camera, uint32_t imageWidth, uint32_t imageHeight)
+{
+    return {camera.getProjection(imageWidth, imageHeight), imageWidth, imageHeight};
+}
+
+static void writeHeader(std::ostream& ofs, const Canvas& canvas)
+{
+    ofs << "<svg version=\"1.1\" xmlns:xlink=\"http://www.w3.org/1999/xlink\" xmlns=\"http://www.w3.org/2000/svg\" width=\"" << canvas.imageWidth << "\" height=\"" << canvas.imageHeight << "\">" << std::endl;
+}
+
+// Draw every triangle of a mesh as three svg lines. objectToCamera takes the mesh's vertices straight to camera space.
+static void drawMesh(std::ostream& ofs, const std::vector<Vec3f>& vertices, const std::vector<int>& triangles, const Matrix44f& objectToCamera, const Canvas& canvas)
+{
+    Matrix44f objectToRaster = objectToCamera * canvas.projection;
+    float imageWidth = (float)canvas.imageWidth, imageHeight = (float)canvas.imageHeight;
+
+    PROFILE_SCOPE("projection_and_output");
+    PROFILE_COUNT("triangles_processed", triangles.size() / 3);
+    PROFILE_COUNT("triangles_emitted", triangles.size() / 3);
+    for (size_t i{0}; i < triangles.size() / 3; ++i)
+    {
+        Vec2i v0Raster, v1Raster, v2Raster;
+
+        // Visible only if all vertices making up that triangle are in the canvas frame
+        bool visible = true;
+        visible &= computeCoordinates(vertices[triangles[i * 3]], objectToRaster, imageWidth, imageHeight, v0Raster);
+        visible &= computeCoordinates(vertices[triangles[i * 3 + 1]], objectToRaster, imageWidth, imageHeight, v1Raster);
+        visible &= computeCoordinates(vertices[triangles[i * 3 + 2]], objectToRaster, imageWidth, imageHeight, v2Raster);
+
+        int val = visible ? 0 : 255; // Black if visible, red if not visible
+        PROFILE_COUNT("triangles_culled", !visible);
+
+        ofs << "<line x1=\"" << v0Raster.x << "\" y1=\"" << v0Raster.y << "\" x2=\"" << v1Raster.x << "\" y2=\"" << v1Raster.y << "\" style=\"stroke:rgb(" << val << ",0,0);stroke-width:1\" />\n";
+        ofs << "<line x1=\"" << v1Raster.x << "\" y1=\"" << v1Raster.y << "\" x2=\"" << v2Raster.x << "\" y2=\"" << v2Raster.y << "\" style=\"stroke:rgb(" << val << ",0,0);stroke-width:1\" />\n";
+        ofs << "<line x1=\"" << v2Raster.x << "\" y1=\"" << v2Raster.y << "\" x2=\"" << v0Raster.x << "\" y2=\"" << v0Raster.y << "\" style=\"stroke:rgb(" << val << ",0,0);stroke-width:1\" />\n";
+    }
+}
+
+// Text as an svg attribute value in double quotes. Object names come straight from the obj file, and may hold any character.
+static void writeAttribute(std::ostream& ofs, const std::string& text)
+{
+    for (char c : text)
+    {
+        switch (c)
+        {
+            case '"': ofs << "&quot;"; break;
+            case '<': ofs << "&lt;"; break;
+            case '&': ofs << "&amp;"; break;
+            default: ofs << c;
+        }
+    }
+}
+
+// Svg group of one object
+static std::string drawObject(const Camera& camera, const SceneObject& object, const Matrix44f& worldToCamera, const Canvas& canvas)
+{
+    std::ostringstream oss;
+    oss << "<g id=\"";
+    writeAttribute(oss, object.getName());
+    oss << "\">\n";
+    if (object.getLODs().size() > 0)
+    {
+        const LODLevel& level = object.getLODs().select(camera, worldToCamera, canvas.imageHeight);
+        drawMesh(oss, level.vertices, level.triangles, worldToCamera, canvas);
+    } else
+    {
+        drawMesh(oss, object.getVertices(), object.getTriangles(), worldToCamera, canvas);
+    }
+    oss << "</g>\n";
+    return oss.str();
+}
+
+// [comment]
+// Indices of the objects not hidden behind others. The objects covering most of the screen are drawn into an occlusion buffer as
+// occluders, then every object's box is tested against it. An occluder is never hidden by itself, since its box is nearer than its triangles.
+// [/comment]
+template<typename GetObject>
+static std::vector<size_t> findUnoccluded(const Camera& camera, size_t count, GetObject getObject, const Matrix44f& worldToCamera, const Canvas& canvas)
+{
+    // Few occluders are needed to hide most of a cluttered scene, and small ones hide little for the triangles they cost
+    constexpr size_t MAX_OCCLUDERS = 8;
+    constexpr float MIN_OCCLUDER_AREA = 64;     // Occlusion buffer pixels
+
+    PROFILE_SCOPE("occlusion_culling");
+    OcclusionBuffer buffer(canvas.imageWidth, canvas.imageHeight);
+    buffer.clear(worldToCamera * canvas.projection, camera.getNearClippingPlane());
+
+    BoxBatch boxes(count);
+    for (size_t i{0}; i < count; ++i)
+    {
+        const SceneObject& object = getObject(i);
+        boxes.set(i, object.getBoundsMin(), object.getBoundsMax());
+    }
+    std::vector<ScreenBox> screenBoxes;
+    buffer.project(boxes, screenBoxes);
+
+    // Largest on screen first. A box reaching behind the camera may cover it all.
+    float bufferArea = (float)buffer.getWidth() * buffer.getHeight();
+    std::vector<std::pair<float, size_t>> candidates;
+    for (size_t i{0}; i < count; ++i)
+    {
+        const ScreenBox& box = screenBoxes[i];
+        float area = box.nearest < camera.getNearClippingPlane() ? bufferArea
+                   : (std::clamp(box.right, 0.0f, (float)buffer.getWidth()) - std::clamp(box.left, 0.0f, (float)buffer.getWidth())) *
+                     (std::clamp(box.bottom, 0.0f, (float)buffer.getHeight()) - std::clamp(box.top, 0.0f, (float)buffer.getHeight()));
+        if (area >= MIN_OCCLUDER_AREA) { candidates.emplace_back(area, i); }
+    }
+    size_t occluders = std::min(candidates.size(), MAX_OCCLUDERS);
+    std::partial_sort(candidates.begin(), candidates.begin() + occluders, candidates.end(), std::greater<>());
+    for (size_t c{0}; c < occluders; ++c)
+    {
+        const SceneObject& object = getObject(candidates[c].second);
+        buffer.drawOccluder(object.getVertices(), object.getTriangles());
+    }
+    buffer.buildHierarchy();
+
+    std::vector<size_t> unoccluded;
+    for (size_t i{0}; i < count; ++i)
+    {
+        if (!buffer.isOccluded(screenBoxes[i])) { unoccluded.push_back(i); }
+    }
+    PROFILE_COUNT("objects_occluded", count - unoccluded.size());
+    return unoccluded;
+}
+
+// Draws count objects, getting the i-th one from getObject(i). Returns the number drawn.
+template<typename GetObject>
+static size_t renderObjects(const Camera& camera, size_t count, GetObject getObject, std::string filename, uint32_t imageWidth, uint32_t imageHeight, bool cullOccluded)
+{
+    Matrix44f worldToCamera;
+    {
+        PROFILE_SCOPE("camera_inverse");
+        worldToCamera = camera.getCameraToWorld().inverse();
+    }
+    Canvas canvas = makeCanvas(camera, imageWidth, imageHeight);
+
+    std::vector<size_t> drawn;
+    if (cullOccluded)
+    {
+        drawn = findUnoccluded(camera, count, getObject, worldToCamera, canvas);
+    } else
+    {
+        drawn.resize(count);
+        for (size_t i{0}; i < count; ++i) { drawn[i] = i; }
+    }
+
+    // Every object's group is projected and written out on the job system, then they go to the file in order
+    std::vector<std::string> groups(drawn.size());
+    JobSystem::instance().parallelFor(drawn.size(), 1, [&](size_t begin, size_t end)
+    {
+        for (size_t d{begin}; d < end; ++d)
+        {
+            groups[d] = drawObject(camera, getObject(drawn[d]), worldToCamera, canvas);
+        }
+    });
+
+    std::ofstream ofs(filename);
+    writeHeader(ofs, canvas);
+    for (const std::string& group : groups)
+    {
+        ofs.write(group.data(), group.size());
+    }
+    ofs << "</svg>\n";
+    PROFILE_COUNT("bytes_written", (size_t)ofs.tellp());
+    return drawn.size();
+}
+
+size_t renderScene(const Camera& camera, const std::vector<SceneObject>& objects, std::string filename, uint32_t imageWidth, uint32_t imageHeight, bool cullOccluded)
+{
+    return renderObjects(camera, objects.size(), [&](size_t i) -> const SceneObject& { return objects[i]; }, filename, imageWidth, imageHeight, cullOccluded);
+}
+
+size_t renderScene(const Camera& camera, const SceneSnapshot& objects, std::string filename, uint32_t imageWidth, uint32_t imageHeight, bool cullOccluded)
+{
+    return renderObjects(camera, objects.size(), [&](size_t i) -> const SceneObject& { return *objects[i]; }, filename, imageWidth, imageHeight, cullOccluded);
+}
+
+void renderScene(const Camera& camera, const InstancedScene& scene, std::string filename, uint32_t imageWidth, uint32_t imageHeight)
+{
+    SceneRenderer renderer(imageWidth, imageHeight);
+    renderer.render(camera, scene, filename);
+}
+
+// Svg group of one instance
+static std::string drawInstance(const Camera& camera, const InstancedScene& scene, const Canvas& canvas, const Matrix44f& instanceToCamera, size_t i)
+{
+    std::ostringstream oss;
+    oss << "<g id=\"";
+    writeAttribute(oss, scene.getNames()[i]);
+    oss << "\">\n";
+    const Mesh& mesh = scene.getMeshes()[scene.getInstanceMeshes()[i]];
+    if (mesh.lods.size() > 0)
+    {
+        const LODLevel& level = mesh.lods.select(camera, instanceToCamera, canvas.imageHeight);
+        drawMesh(oss, level.vertices, level.triangles, instanceToCamera, canvas);
+    } else
+    {
+        drawMesh(oss, mesh.vertices, mesh.triangles, instanceToCamera, canvas);
+    }
+    oss << "</g>\n";
+    return oss.str();
+}
+
+static bool sameMatrix(const Matrix44f& a, const Matrix44f& b)
+{
+    return std::equal(&a[0][0], &a[0][0] + 16, &b[0][0]);
+}
+
+size_t SceneRenderer::render(const Camera& camera, const InstancedScene& scene, std::string filename)
+{
+    Matrix44f worldToCamera;
+    {
+        PROFILE_SCOPE("camera_inverse");
+        worldToCamera = camera.getCameraToWorld().inverse();
+    }
+    Canvas canvas = makeCanvas(camera, _imageWidth, _imageHeight);
+
+    // A different camera, or a different number of instances, leaves nothing worth keeping
+    if (!sameMatrix(worldToCamera, _worldToCamera) || !sameMatrix(canvas.projection, _projection) || _fragments.size() != scene.getInstanceCount())
+    {
+        _worldToCamera = worldToCamera;
+        _projection = canvas.projection;
+        _fragments.assign(scene.getInstanceCount(), Fragment());
+    }
+
+    Matrix44Batch instanceToCamera;
+    scene.computeInstanceToCamera(worldToCamera, instanceToCamera);
+
+    std::vector<size_t> stale;
+    for (size_t i{0}; i < scene.getInstanceCount(); ++i)
+    {
+        if (!_fragments[i].valid || _fragments[i].version != scene.getVersions()[i]) { stale.push_back(i); }
+    }
+
+    // Fragments are independent, so they are regenerated on the job system
+    JobSystem::instance().parallelFor(stale.size(), 1, [&](size_t begin, size_t end)
+    {
+        for (size_t s{begin}; s < end; ++s)
+        {
+            size_t i = stale[s];
+            _fragments[i].svg = drawInstance(camera, scene, canvas, instanceToCamera.get(i), i);
+            _fragments[i].version = scene.getVersions()[i];
+            _fragments[i].valid = true;
+        }
+    });
+    PROFILE_COUNT("fragments_regenerated", stale.size());
+
+    PROFILE_SCOPE("file_output");
+    std::ofstream ofs(filename);
+    writeHeader(ofs, canvas);
+    for (const Fragment& fragment : _fragments)
+    {
+        ofs.write(fragment.svg.data(), fragment.svg.size());
+    }
+    ofs << "</svg>\n";
+    PROFILE_COUNT("bytes_written", (size_t)ofs.tellp());
+    return stale.size();
+}
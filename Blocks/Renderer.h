@@ -0,0 +1,43 @@
+// Draws the objects of a scene as seen from a camera.
+#pragma once
+
+#include "Camera.h"
+#include "SceneObject.h"
+#include "Instancing.h"
+#include "LiveScene.h"
+#include <string>
+#include <vector>
+
+// Renders a wireframe of every object into an svg file. Objects with an LOD chain are drawn with the level matching their size on screen.
+// With cullOccluded, objects hidden behind the largest ones on screen are left out (see Occlusion.h). Returns the number of objects drawn.
+size_t renderScene(const Camera& camera, const std::vector<SceneObject>& objects, std::string filename, uint32_t imageWidth = 512, uint32_t imageHeight = 512, bool cullOccluded = false);
+
+// Same, for a snapshot of a scene being edited live
+size_t renderScene(const Camera& camera, const SceneSnapshot& objects, std::string filename, uint32_t imageWidth = 512, uint32_t imageHeight = 512, bool cullOccluded = false);
+
+// Same, for a scene where repeated geometry is shared between instances
+void renderScene(const Camera& camera, const InstancedScene& scene, std::string filename, uint32_t imageWidth = 512, uint32_t imageHeight = 512);
+
+// Renders an instanced scene again and again as it is edited. Every instance is drawn in its own <g> group, whose text is kept
+// along with what it was made from: the instance's version (see InstancedScene::getVersions) and the camera.
+// The next render only regenerates the groups whose instance changed, or all of them if the camera did, and splices the rest back in as is.
+class SceneRenderer
+{
+public:
+    SceneRenderer(uint32_t imageWidth = 512, uint32_t imageHeight = 512) : _imageWidth(imageWidth), _imageHeight(imageHeight) {}
+
+    // Returns the number of groups that had to be regenerated
+    size_t render(const Camera& camera, const InstancedScene& scene, std::string filename);
+
+private:
+    struct Fragment
+    {
+        bool valid = false;
+        uint64_t version = 0;
+        std::string svg;
+    };
+
+    uint32_t _imageWidth, _imageHeight;
+    Matrix44f _worldToCamera, _projection;  // Camera the fragments were drawn with
+    std::vector<Fragment> _fragments;       // One per instance
+};
@@ -0,0 +1,98 @@
+#include "SceneGraph.h"
+#include <functional>
+
+int SceneGraph::addNode(std::string name, int parent, const Matrix44f& local)
+{
+    int handle = (int)_slots.size();
+    SceneNode node;
+    node.name = name;
+    node.local = local;
+    _nodes.push_back(node);
+    _slots.push_back((int)_nodes.size() - 1);
+    _parents.push_back(parent);
+
+    // The new node may belong in the middle of an existing subtree, so the order is rebuilt on the next update
+    _flattened = false;
+    return handle;
+}
+
+int SceneGraph::find(std::string name) const
+{
+    for (size_t handle{0}; handle < _slots.size(); ++handle)
+    {
+        if (_nodes[_slots[handle]].name == name) { return (int)handle; }
+    }
+    return -1;
+}
+
+void SceneGraph::setLocal(int node, const Matrix44f& local)
+{
+    SceneNode& n = _nodes[_slots[node]];
+    n.local = local;
+    n.dirty = true;
+}
+
+void SceneGraph::flatten()
+{
+    std::vector<std::vector<int>> children(_slots.size());
+    std::vector<int> roots;
+    for (size_t handle{0}; handle < _parents.size(); ++handle)
+    {
+        if (_parents[handle] < 0) { roots.push_back((int)handle); }
+        else { children[_parents[handle]].push_back((int)handle); }
+    }
+
+    std::vector<SceneNode> nodes;
+    nodes.reserve(_nodes.size());
+    std::vector<int> slots(_slots.size());
+
+    std::function<void(int, int)> visit = [&](int handle, int parentSlot)
+    {
+        int slot = (int)nodes.size();
+        slots[handle] = slot;
+        nodes.push_back(_nodes[_slots[handle]]);
+        nodes[slot].parent = parentSlot;
+        for (int child : children[handle])
+        {
+            visit(child, slot);
+        }
+        nodes[slot].subtreeEnd = (int)nodes.size();
+    };
+    for (int root : roots)
+    {
+        visit(root, -1);
+    }
+
+    _nodes = std::move(nodes);
+    _slots = std::move(slots);
+    _flattened = true;
+}
+
+size_t SceneGraph::update()
+{
+    if (!_flattened) { flatten(); }
+
+    size_t updated = 0;
+    size_t i = 0;
+    while (i < _nodes.size())
+    {
+        if (!_nodes[i].dirty)
+        {
+            ++i;
+            continue;
+        }
+
+        // Everything below a dirty node needs its world matrix again. Parents come first, so one linear pass over the range does it.
+        size_t end = _nodes[i].subtreeEnd;
+        for (size_t j{i}; j < end; ++j)
+        {
+            SceneNode& node = _nodes[j];
+            if (node.parent < 0) { node.world = node.local; }
+            else { Matrix44f::multiply(node.local, _nodes[node.parent].world, node.world); }
+            node.dirty = false;
+        }
+        updated += end - i;
+        i = end;
+    }
+    return updated;
+}
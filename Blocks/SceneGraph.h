@@ -0,0 +1,43 @@
+// Hierarchy of transforms. Moving a node moves everything below it (e.g. the cups and legs of the headphones follow the body)
+// without touching any vertices, and only the subtrees that moved get their world matrices recomputed.
+#pragma once
+
+#include "geometry.h"
+#include <string>
+#include <vector>
+
+struct SceneNode
+{
+    std::string name;
+    int parent = -1;        // Slot of the parent in the flattened order, -1 for roots
+    int subtreeEnd = 0;     // One past the slot of this node's last descendant
+    Matrix44f local;        // Transform relative to the parent
+    Matrix44f world;        // Transform relative to the world, i.e. local concatenated with every ancestor
+    bool dirty = true;      // local changed since world was last computed
+};
+
+class SceneGraph
+{
+public:
+    // Returns a handle to the node that stays valid as more nodes are added
+    int addNode(std::string name, int parent = -1, const Matrix44f& local = Matrix44f());
+    int find(std::string name) const;
+
+    void setLocal(int node, const Matrix44f& local);
+    const Matrix44f& getLocal(int node) const { return _nodes[_slots[node]].local; }
+    const Matrix44f& getWorld(int node) const { return _nodes[_slots[node]].world; }
+
+    // Recompute the world matrices of every dirty subtree. Returns how many nodes were recomputed.
+    size_t update();
+
+    size_t size() const { return _nodes.size(); }
+
+private:
+    void flatten();
+
+    // Nodes are kept in depth first order, so a parent always comes before its children and every subtree is one contiguous range
+    std::vector<SceneNode> _nodes;
+    std::vector<int> _slots;        // Handle to slot in _nodes
+    std::vector<int> _parents;      // Handle to parent handle, used to rebuild the order when nodes are added
+    bool _flattened = true;
+};
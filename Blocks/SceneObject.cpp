@@ -1,32 +1,52 @@
 #include "SceneObject.h"
 #include "geometry.h"
+#include "Profiler.h"
+#include "VertexCache.h"
+#include "Morton.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <optional>
 #include <fstream>
-#include <sstream>
+#include <string_view>
+#include <cstdlib>
 #include <iostream>
+#include <limits>
 
 const std::string OBJ_FILE = "blocks.obj";
 
-SceneObject::SceneObject(std::string name) : _name{name}
+// What follows the keyword of an "o", "mtllib" or "usemtl" record, which is a name that may contain spaces.
+// Trailing whitespace, including the \r of a file with Windows line endings, isn't part of it.
+static std::string recordName(std::string_view record)
 {
+    record.remove_prefix(std::min(record.find(' '), record.size()));
+    while (!record.empty() && (record.front() == ' ' || record.front() == '\t')) { record.remove_prefix(1); }
+    while (!record.empty() && (record.back() == '\r' || record.back() == ' ' || record.back() == '\t')) { record.remove_suffix(1); }
+    return std::string(record);
+}
+
+SceneObject::SceneObject(std::string name, std::string filename) : _name{name}
+{
+    PROFILE_SCOPE("parse");
     // Verify the object exists in the file path name
     try
     {
-        _inFile.open(OBJ_FILE);
+        _inFile.open(filename);
     } catch(const std::exception& e)
     {
         std::cerr << e.what() << '\n';
     }
 
-    std::string line, temp;
+    std::string line;
+    ParseState state;
     bool objLocated = false;
-    // Parse the obj file for the object we want to get data from
+    // Parse the obj file for the object we want to get data from.
+    // Records are read in place from the line rather than through a stream per line, which would allocate every time.
     while (std::getline(_inFile, line))
     {
-        std::istringstream iss{line};
-        iss >> temp;
+        std::string_view record{line};
 
         // Object declaration started
-        if (temp == "o")
+        if (record.starts_with("o "))
         {
             if (objLocated)
             {
@@ -35,23 +55,212 @@ SceneObject::SceneObject(std::string name) : _name{name}
                 break;
             }
 
-            iss >> temp;
-            if (temp == name)
+            if (recordName(record) == name)
             {
                 // Found our target object to get data on
                 objLocated = true;
             }
         } else if (objLocated)
         {
-            if (temp == "v")
+            parseRecord(line, state);
+        } else if (record.starts_with("v "))
+        {
+            // Face indices in an obj file count vertices from the start of the file, so keep track of how many came before our object
+            state.vertexOffset++;
+        } else if (record.starts_with("vt "))
+        {
+            state.texCoordOffset++;
+        } else if (record.starts_with("mtllib "))
+        {
+            state.library = MaterialCache::instance().getLibrary(resolvePath(recordName(record), filename));
+        }
+    }
+
+    finishParsing();
+}
+
+SceneObject::SceneObject(std::string name, std::string_view block, int vertexOffset, int texCoordOffset, std::string materialLibrary) : _name{name}
+{
+    PROFILE_SCOPE("parse");
+    ParseState state;
+    state.vertexOffset = vertexOffset;
+    state.texCoordOffset = texCoordOffset;
+    if (!materialLibrary.empty()) { state.library = MaterialCache::instance().getLibrary(materialLibrary); }
+
+    // Records are parsed from a null terminated copy of each line, so number parsing can't run on into the next line
+    std::string line;
+    while (!block.empty())
+    {
+        size_t end = std::min(block.find('\n'), block.size());
+        line.assign(block.substr(0, end));
+        block.remove_prefix(std::min(end + 1, block.size()));
+        parseRecord(line, state);
+    }
+
+    finishParsing();
+}
+
+void SceneObject::parseRecord(const std::string& line, ParseState& state)
+{
+    std::string_view record{line};
+    if (record.starts_with("v "))
+    {
+        // Found vertex data
+        char* end;
+        float x = std::strtof(line.c_str() + 2, &end);
+        float y = std::strtof(end, &end);
+        float z = std::strtof(end, &end);
+        _vertices.emplace_back(x,y,z);
+    } else if (record.starts_with("vt "))
+    {
+        char* end;
+        float u = std::strtof(line.c_str() + 3, &end);
+        float v = std::strtof(end, &end);
+        _texCoords.emplace_back(u, v);
+    } else if (record.starts_with("f "))
+    {
+        // Found face data, each corner is written as v/vt/vn, v//vn, v/vt or v, and the normal isn't needed.
+        // Polygons are split into a fan of triangles.
+        state.corners.clear();
+        state.cornerTexCoords.clear();
+        const char* p = line.c_str() + 2;
+        char* end;
+        // Negative indices count back from the last vertex read so far. Anything still outside the object's vertices is dropped in finishParsing.
+        for (long index = std::strtol(p, &end, 10); end != p; index = std::strtol(p, &end, 10))
+        {
+            state.corners.push_back(index < 0 ? (int)(_vertices.size() + index) : (int)index - 1 - state.vertexOffset);
+            p = end;
+            int texCoord = -1;
+            if (*p == '/' && p[1] != '/')
             {
-                // Found vertex data
-                float x, y, z;
-                iss >> x >> y >> z;
-                _vertices.emplace_back(x,y,z);
+                long texIndex = std::strtol(p + 1, &end, 10);
+                if (end != p + 1) { texCoord = texIndex < 0 ? (int)(_texCoords.size() + texIndex) : (int)texIndex - 1 - state.texCoordOffset; }
             }
+            state.cornerTexCoords.push_back(texCoord);
+            // Skip the rest of this corner
+            while (*p != '\0' && *p != ' ') { ++p; }
+        }
+        const std::vector<int>& corners = state.corners;
+        const std::vector<int>& texCoords = state.cornerTexCoords;
+        for (size_t i{1}; i + 1 < corners.size(); ++i)
+        {
+            _triangles.push_back(corners[0]);
+            _triangles.push_back(corners[i]);
+            _triangles.push_back(corners[i + 1]);
+            _cornerTexCoords.push_back(texCoords[0]);
+            _cornerTexCoords.push_back(texCoords[i]);
+            _cornerTexCoords.push_back(texCoords[i + 1]);
+            if (!_materials.empty()) { _triangleMaterials.push_back(state.material); }
+        }
+    } else if (record.starts_with("usemtl "))
+    {
+        // A name missing from the library leaves the faces that follow without a material
+        state.material = -1;
+        if (!state.library) { return; }
+        auto found = state.library->find(recordName(record));
+        if (found == state.library->end()) { return; }
+
+        // The faces before the first material have none
+        if (_materials.empty()) { _triangleMaterials.assign(_triangles.size() / 3, -1); }
+        auto used = std::find(_materials.begin(), _materials.end(), found->second);
+        if (used == _materials.end()) { used = _materials.insert(_materials.end(), found->second); }
+        state.material = (int)(used - _materials.begin());
+    }
+}
+
+void SceneObject::finishParsing()
+{
+    // A bad or truncated file can name vertices the object doesn't have. Those triangles are dropped, and texture coordinates out of
+    // range are treated as missing, so nothing after this indexes past the end of the object's data.
+    size_t kept = 0;
+    for (size_t t{0}; t < _triangles.size() / 3; ++t)
+    {
+        bool valid = true;
+        for (int c{0}; c < 3; ++c)
+        {
+            int index = _triangles[t * 3 + c];
+            if (index < 0 || index >= (int)_vertices.size()) { valid = false; }
+            int& texCoord = _cornerTexCoords[t * 3 + c];
+            if (texCoord < 0 || texCoord >= (int)_texCoords.size()) { texCoord = -1; }
+        }
+        if (!valid) { continue; }
+        for (int c{0}; c < 3; ++c)
+        {
+            _triangles[kept * 3 + c] = _triangles[t * 3 + c];
+            _cornerTexCoords[kept * 3 + c] = _cornerTexCoords[t * 3 + c];
+        }
+        if (!_triangleMaterials.empty()) { _triangleMaterials[kept] = _triangleMaterials[t]; }
+        kept++;
+    }
+    if (kept < _triangles.size() / 3)
+    {
+        std::cerr << _name << ": dropped " << _triangles.size() / 3 - kept << " faces with vertex indices out of range" << '\n';
+        _triangles.resize(kept * 3);
+        _cornerTexCoords.resize(kept * 3);
+        if (!_triangleMaterials.empty()) { _triangleMaterials.resize(kept); }
+    }
+
+    _fileACMR = computeACMR(_triangles);
+    std::vector<int> triangleOrder;
+    optimizeVertexCache(_vertices, _triangles, &triangleOrder);
+    _optimizedACMR = computeACMR(_triangles);
+
+    // Per corner and per triangle data follows the triangles to their new place
+    std::vector<int> cornerTexCoords(_cornerTexCoords.size()), triangleMaterials(_triangleMaterials.size());
+    for (size_t t{0}; t < triangleOrder.size(); ++t)
+    {
+        for (int c{0}; c < 3; ++c) { cornerTexCoords[t * 3 + c] = _cornerTexCoords[triangleOrder[t] * 3 + c]; }
+        if (!_triangleMaterials.empty()) { triangleMaterials[t] = _triangleMaterials[triangleOrder[t]]; }
+    }
+    _cornerTexCoords.swap(cornerTexCoords);
+    _triangleMaterials.swap(triangleMaterials);
+
+    _boundsMin = Vec3f(std::numeric_limits<float>::max());
+    _boundsMax = Vec3f(std::numeric_limits<float>::lowest());
+    for (const Vec3f& v : _vertices)
+    {
+        _boundsMin = Vec3f(std::min(_boundsMin.x, v.x), std::min(_boundsMin.y, v.y), std::min(_boundsMin.z, v.z));
+        _boundsMax = Vec3f(std::max(_boundsMax.x, v.x), std::max(_boundsMax.y, v.y), std::max(_boundsMax.z, v.z));
+    }
+}
+
+void SceneObject::sortVerticesMorton()
+{
+    ::sortVerticesMorton(_vertices, _triangles);
+}
+
+std::vector<std::string> SceneObject::getObjectNames(std::string filename)
+{
+    std::vector<std::string> names;
+    std::ifstream inFile(filename);
+
+    std::string line;
+    while (std::getline(inFile, line))
+    {
+        if (line.starts_with("o "))
+        {
+            names.push_back(recordName(line));
         }
     }
+    return names;
+}
+
+std::vector<SceneObject> SceneObject::loadAll(std::string filename)
+{
+    std::vector<std::string> names = getObjectNames(filename);
+    std::vector<std::optional<SceneObject>> parsed(names.size());
+    JobSystem::instance().parallelFor(names.size(), 1, [&](size_t begin, size_t end)
+    {
+        for (size_t i{begin}; i < end; ++i) { parsed[i].emplace(names[i], filename); }
+    });
+
+    std::vector<SceneObject> objects;
+    objects.reserve(names.size());
+    for (std::optional<SceneObject>& object : parsed)
+    {
+        objects.push_back(std::move(*object));
+    }
+    return objects;
 }
 
 void SceneObject::print()
@@ -62,4 +271,4 @@ void SceneObject::print()
         std::cout << vertex << std::endl;
     }
     std::cout << std::endl << std::endl;
-}
\ No newline at end of file
+}
@@ -1,15 +1,83 @@
+#pragma once
+
 #include <fstream>
 #include "geometry.h"
+#include "LOD.h"
+#include "Material.h"
+#include <memory>
+#include <string>
+#include <string_view>
 #include <vector>
 
+extern const std::string OBJ_FILE;
+
 class SceneObject
 {
 public:
-    SceneObject(std::string name);
+    SceneObject(std::string name, std::string filename = OBJ_FILE);
+    // From the records of one object already read from an obj file (the lines after its "o" record).
+    // vertexOffset and texCoordOffset are the number of vertices and texture coordinates declared before the object, which face indices
+    // count from. materialLibrary is the path of the file's last "mtllib" before the object, if any.
+    SceneObject(std::string name, std::string_view block, int vertexOffset, int texCoordOffset = 0, std::string materialLibrary = "");
     void print();
 
+    const std::string& getName() const { return _name; }
+    const std::vector<Vec3f>& getVertices() const { return _vertices; }
+    const std::vector<int>& getTriangles() const { return _triangles; }
+
+    // Texture coordinates ("vt" records), and per corner of every triangle the index of its own, or -1. Level 0 only, LODs have none.
+    const std::vector<Vec2f>& getTexCoords() const { return _texCoords; }
+    const std::vector<int>& getCornerTexCoords() const { return _cornerTexCoords; }
+
+    // Materials the faces use ("usemtl" records), shared with every other object using them (see Material.h), and per triangle
+    // the index of its material, or -1. Both empty if no face has a material.
+    const std::vector<std::shared_ptr<const Material>>& getMaterials() const { return _materials; }
+    const std::vector<int>& getTriangleMaterials() const { return _triangleMaterials; }
+
+    // Axis aligned box around the vertices
+    const Vec3f& getBoundsMin() const { return _boundsMin; }
+    const Vec3f& getBoundsMax() const { return _boundsMax; }
+
+    // Vertex cache miss ratio of the faces in file order, and after loading reordered them (see VertexCache.h)
+    float getFileACMR() const { return _fileACMR; }
+    float getOptimizedACMR() const { return _optimizedACMR; }
+
+    // Optionally store the vertices in Morton order rather than first use order (see Morton.h). Do it before building LODs.
+    void sortVerticesMorton();
+
+    // Simplified versions of the object, picked at render time depending on how large it appears. Empty until built or loaded.
+    void buildLODs(int maxLevels = 6) { _lods = LODChain(_vertices, _triangles, maxLevels); }
+    void loadLODs(std::string filename) { _lods = LODChain::load(filename, _name, _vertices, _triangles); }
+    const LODChain& getLODs() const { return _lods; }
+
+    // Names of every object declared (with an "o" record) in an obj file, in file order.
+    static std::vector<std::string> getObjectNames(std::string filename = OBJ_FILE);
+
+    // Every object of an obj file, in file order, parsed in parallel on the job system
+    static std::vector<SceneObject> loadAll(std::string filename = OBJ_FILE);
+
 private:
+    // Where parsing has got to. Indices in face records count from the start of the file.
+    struct ParseState
+    {
+        int vertexOffset = 0, texCoordOffset = 0;
+        std::shared_ptr<const MaterialLibrary> library;
+        int material = -1;      // Index in _materials of the current "usemtl"
+        std::vector<int> corners, cornerTexCoords;
+    };
+
+    void parseRecord(const std::string& line, ParseState& state);
+    void finishParsing();
+
     std::string _name;
     std::vector<Vec3f> _vertices;
+    std::vector<int> _triangles;    // Every 3 entries index a triangle in _vertices
+    std::vector<Vec2f> _texCoords;
+    std::vector<int> _cornerTexCoords;
+    std::vector<std::shared_ptr<const Material>> _materials;
+    std::vector<int> _triangleMaterials;
+    Vec3f _boundsMin, _boundsMax;
+    LODChain _lods;
+    float _fileACMR = 0, _optimizedACMR = 0;
     std::ifstream _inFile;
-};
\ No newline at end of file
+};
@@ -0,0 +1,258 @@
+#include "Texture.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+namespace
+{
+    uint32_t packRGBA(uint32_t r, uint32_t g, uint32_t b, uint32_t a = 255)
+    {
+        return r | g << 8 | b << 16 | a << 24;
+    }
+
+    // Next number of a PPM header, skipping whitespace and # comments. Returns -1 past the end or on anything else.
+    long readHeaderNumber(const std::string& bytes, size_t& p)
+    {
+        while (p < bytes.size() && (std::isspace((unsigned char)bytes[p]) || bytes[p] == '#'))
+        {
+            if (bytes[p] == '#') { p = std::min(bytes.find('\n', p), bytes.size()); } else { ++p; }
+        }
+        if (p == bytes.size() || !std::isdigit((unsigned char)bytes[p])) { return -1; }
+        long value = 0;
+        while (p < bytes.size() && std::isdigit((unsigned char)bytes[p])) { value = value * 10 + (bytes[p++] - '0'); }
+        return value;
+    }
+
+    bool decodePPM(const std::string& bytes, uint32_t& width, uint32_t& height, std::vector<uint32_t>& rgba)
+    {
+        bool binary = bytes[1] == '6';
+        size_t p = 2;
+        long w = readHeaderNumber(bytes, p), h = readHeaderNumber(bytes, p), maxValue = readHeaderNumber(bytes, p);
+        if (w <= 0 || h <= 0 || maxValue <= 0 || maxValue > 65535) { return false; }
+        width = (uint32_t)w;
+        height = (uint32_t)h;
+        rgba.resize((size_t)width * height);
+
+        // Samples wider than a byte are big endian. Either way they are scaled to [0, 255].
+        size_t sampleSize = maxValue > 255 ? 2 : 1;
+        p++;    // The single whitespace ending the header
+        if (binary && bytes.size() < p + rgba.size() * 3 * sampleSize) { return false; }
+        auto next = [&]() -> uint32_t
+        {
+            long value;
+            if (binary)
+            {
+                value = sampleSize == 2 ? (unsigned char)bytes[p] << 8 | (unsigned char)bytes[p + 1] : (unsigned char)bytes[p];
+                p += sampleSize;
+            } else
+            {
+                value = std::max(0L, readHeaderNumber(bytes, p));
+            }
+            return (uint32_t)((std::min(value, maxValue) * 255 + maxValue / 2) / maxValue);
+        };
+        for (uint32_t& texel : rgba)
+        {
+            uint32_t r = next(), g = next(), b = next();
+            texel = packRGBA(r, g, b);
+        }
+        return true;
+    }
+
+    bool decodeTGA(const std::string& bytes, uint32_t& width, uint32_t& height, std::vector<uint32_t>& rgba)
+    {
+        if (bytes.size() < 18) { return false; }
+        auto byte = [&](size_t i) -> uint32_t { return (unsigned char)bytes[i]; };
+        uint32_t idLength = byte(0), colorMapType = byte(1), imageType = byte(2);
+        uint32_t colorMapLength = byte(5) | byte(6) << 8, colorMapEntryBits = byte(7);
+        width = byte(12) | byte(13) << 8;
+        height = byte(14) | byte(15) << 8;
+        uint32_t bitsPerPixel = byte(16), descriptor = byte(17);
+
+        // True colour (2, 10 run length encoded) and grey (3, 11), no colour mapped images
+        bool grey = imageType == 3 || imageType == 11, runLength = imageType == 10 || imageType == 11;
+        if (!(imageType == 2 || grey || runLength) || width == 0 || height == 0) { return false; }
+        if (grey ? bitsPerPixel != 8 : !(bitsPerPixel == 16 || bitsPerPixel == 24 || bitsPerPixel == 32)) { return false; }
+        size_t pixelSize = bitsPerPixel / 8;
+        size_t p = 18 + idLength + (colorMapType == 1 ? colorMapLength * ((colorMapEntryBits + 7) / 8) : 0);
+
+        // Pixels are stored blue first, and 16 bit ones as ARRRRRGG GGGBBBBB, little endian
+        auto decode = [&](size_t at) -> uint32_t
+        {
+            if (grey) { return packRGBA(byte(at), byte(at), byte(at)); }
+            if (pixelSize == 2)
+            {
+                uint32_t v = byte(at) | byte(at + 1) << 8;
+                return packRGBA((v >> 10 & 31) * 255 / 31, (v >> 5 & 31) * 255 / 31, (v & 31) * 255 / 31);
+            }
+            return packRGBA(byte(at + 2), byte(at + 1), byte(at), pixelSize == 4 ? byte(at + 3) : 255);
+        };
+
+        // Pixels in file order, which is bottom row first unless bit 5 of the descriptor is set
+        std::vector<uint32_t> pixels((size_t)width * height);
+        for (size_t i{0}; i < pixels.size(); )
+        {
+            size_t count = 1;
+            bool repeat = false;
+            if (runLength)
+            {
+                // A packet header: 1 + the low 7 bits is the count, the high bit says whether one pixel repeats or that many follow
+                if (p >= bytes.size()) { return false; }
+                count = (byte(p) & 127) + 1;
+                repeat = byte(p) & 128;
+                p++;
+            }
+            count = std::min(count, pixels.size() - i);
+            if (p + (repeat ? 1 : count) * pixelSize > bytes.size()) { return false; }
+            for (size_t k{0}; k < count; ++k)
+            {
+                pixels[i + k] = decode(p);
+                if (!repeat) { p += pixelSize; }
+            }
+            if (repeat) { p += pixelSize; }
+            i += count;
+        }
+
+        bool topFirst = descriptor & 32;
+        rgba.resize(pixels.size());
+        for (uint32_t y{0}; y < height; ++y)
+        {
+            uint32_t row = topFirst ? y : height - 1 - y;
+            std::copy(pixels.begin() + (size_t)row * width, pixels.begin() + (size_t)(row + 1) * width, rgba.begin() + (size_t)y * width);
+        }
+        return true;
+    }
+
+    Color unpack(uint32_t texel)
+    {
+        return {(texel & 255) / 255.0f, (texel >> 8 & 255) / 255.0f, (texel >> 16 & 255) / 255.0f, (texel >> 24) / 255.0f};
+    }
+
+    Color mix(const Color& a, const Color& b, float t)
+    {
+        return {a.r + (b.r - a.r) * t, a.g + (b.g - a.g) * t, a.b + (b.b - a.b) * t, a.a + (b.a - a.a) * t};
+    }
+}
+
+std::shared_ptr<const Texture> Texture::load(const std::string& filename)
+{
+    PROFILE_SCOPE("texture_load");
+    std::ifstream file(filename, std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "Can't open texture " << filename << '\n';
+        return nullptr;
+    }
+    std::string bytes{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+
+    // PPM files start with their format, TGA files have no signature and are known by their extension
+    uint32_t width = 0, height = 0;
+    std::vector<uint32_t> rgba;
+    std::string extension = filename.substr(std::min(filename.rfind('.'), filename.size()));
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    bool decoded = false;
+    if (bytes.size() > 2 && bytes[0] == 'P' && (bytes[1] == '6' || bytes[1] == '3'))
+    {
+        decoded = decodePPM(bytes, width, height, rgba);
+    } else if (extension == ".tga")
+    {
+        decoded = decodeTGA(bytes, width, height, rgba);
+    }
+    if (!decoded)
+    {
+        std::cerr << "Can't read texture " << filename << ", only PPM (P6, P3) and uncompressed or run length encoded TGA are supported" << '\n';
+        return nullptr;
+    }
+    return std::make_shared<const Texture>(width, height, rgba);
+}
+
+Texture::Texture(uint32_t width, uint32_t height, const std::vector<uint32_t>& rgba)
+{
+    PROFILE_SCOPE("texture_mip_chain");
+    // Every level's place in the texel array, in whole tiles
+    size_t size = 0;
+    for (uint32_t w{width}, h{height}; ; w = std::max(1u, w / 2), h = std::max(1u, h / 2))
+    {
+        uint32_t tilesPerRow = (w + TILE_SIZE - 1) / TILE_SIZE, tileRows = (h + TILE_SIZE - 1) / TILE_SIZE;
+        _levels.push_back({w, h, tilesPerRow, size});
+        size += (size_t)tilesPerRow * tileRows * TILE_SIZE * TILE_SIZE;
+        if (w == 1 && h == 1) { break; }
+    }
+    _texels.resize(size);
+
+    // Each level is filtered down from the one above it in rows, then scattered into its tiles.
+    // A texel averages the 2x2 above it, or the 2x1 or 1x2 once one side is down to a single texel.
+    std::vector<uint32_t> rows = rgba, next;
+    for (size_t l{0}; l < _levels.size(); ++l)
+    {
+        const Level& level = _levels[l];
+        if (l > 0)
+        {
+            const Level& above = _levels[l - 1];
+            next.resize((size_t)level.width * level.height);
+            for (uint32_t y{0}; y < level.height; ++y)
+            {
+                for (uint32_t x{0}; x < level.width; ++x)
+                {
+                    uint32_t x0 = std::min(2 * x, above.width - 1), x1 = std::min(2 * x + 1, above.width - 1);
+                    uint32_t y0 = std::min(2 * y, above.height - 1), y1 = std::min(2 * y + 1, above.height - 1);
+                    uint32_t corners[4] = {rows[(size_t)y0 * above.width + x0], rows[(size_t)y0 * above.width + x1],
+                                           rows[(size_t)y1 * above.width + x0], rows[(size_t)y1 * above.width + x1]};
+                    uint32_t texel = 0;
+                    for (int shift{0}; shift < 32; shift += 8)
+                    {
+                        uint32_t sum = 2;   // Rounds to nearest
+                        for (uint32_t c : corners) { sum += c >> shift & 255; }
+                        texel |= (sum / 4) << shift;
+                    }
+                    next[(size_t)y * level.width + x] = texel;
+                }
+            }
+            rows.swap(next);
+        }
+
+        for (uint32_t y{0}; y < level.height; ++y)
+        {
+            for (uint32_t x{0}; x < level.width; ++x)
+            {
+                _texels[level.offset + ((y / TILE_SIZE) * level.tilesPerRow + x / TILE_SIZE) * TILE_SIZE * TILE_SIZE + (y % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE] = rows[(size_t)y * level.width + x];
+            }
+        }
+    }
+}
+
+float Texture::selectLevel(float texelsPerPixel) const
+{
+    return std::clamp(std::log2(std::max(texelsPerPixel, 1.0f)), 0.0f, (float)(_levels.size() - 1));
+}
+
+Color Texture::sample(float u, float v, float level) const
+{
+    level = std::clamp(level, 0.0f, (float)(_levels.size() - 1));
+    size_t finer = (size_t)level;
+    float t = level - finer;
+    Color color = sampleBilinear(finer, u, v);
+    if (t > 0 && finer + 1 < _levels.size())
+    {
+        color = mix(color, sampleBilinear(finer + 1, u, v), t);
+    }
+    return color;
+}
+
+Color Texture::sampleBilinear(size_t level, float u, float v) const
+{
+    const Level& l = _levels[level];
+    // Wrap first, so coordinates far outside [0, 1] don't overflow, then move to texel centres. v = 0 is the bottom row.
+    float x = (u - std::floor(u)) * l.width - 0.5f;
+    float y = (1 - (v - std::floor(v))) * l.height - 0.5f;
+    float fx = std::floor(x), fy = std::floor(y);
+    float tx = x - fx, ty = y - fy;
+    uint32_t x0 = ((int)fx + l.width) % l.width, x1 = (x0 + 1) % l.width;
+    uint32_t y0 = ((int)fy + l.height) % l.height, y1 = (y0 + 1) % l.height;
+    Color top = mix(unpack(fetch(level, x0, y0)), unpack(fetch(level, x1, y0)), tx);
+    Color bottom = mix(unpack(fetch(level, x0, y1)), unpack(fetch(level, x1, y1)), tx);
+    return mix(top, bottom, ty);
+}
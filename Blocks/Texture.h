@@ -0,0 +1,64 @@
+// Textures read from PPM or TGA files (no image library needed), with their mip chain built on load.
+//
+// Texels are stored in tiles of 8x8 (256 bytes, four cache lines) rather than row by row. A bilinear lookup reads a 2x2 footprint,
+// and neighbouring lookups read neighbouring footprints: in rows those span two rows of the image, a whole row apart in memory, while
+// in tiles they almost always fall in the same few cache lines, whichever direction the surface runs across the texture.
+// Minified lookups go to the mip level whose texels are about a pixel apart, so they stay just as local instead of skipping through
+// the full size image.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Colour with each channel in [0, 1]
+struct Color
+{
+    float r = 0, g = 0, b = 0, a = 1;
+};
+
+class Texture
+{
+public:
+    static constexpr uint32_t TILE_SIZE = 8;    // Texels along a side of a tile
+
+    // Read a binary or ascii PPM (P6, P3) or an uncompressed or run length encoded TGA (true colour or grey, 8 to 32 bits).
+    // Returns null, with the reason on std::cerr, if the file can't be read or the format isn't one of those.
+    static std::shared_ptr<const Texture> load(const std::string& filename);
+
+    // From rows of packed RGBA texels (see fetch), top row first
+    Texture(uint32_t width, uint32_t height, const std::vector<uint32_t>& rgba);
+
+    uint32_t getWidth(size_t level = 0) const { return _levels[level].width; }
+    uint32_t getHeight(size_t level = 0) const { return _levels[level].height; }
+    size_t getLevelCount() const { return _levels.size(); }
+
+    // Mip level (fractional) whose texels are about a pixel apart, for a lookup where one pixel spans texelsPerPixel full size texels
+    float selectLevel(float texelsPerPixel) const;
+
+    // Texel x, y of a level, as RGBA packed with red in the lowest byte
+    uint32_t fetch(size_t level, uint32_t x, uint32_t y) const
+    {
+        const Level& l = _levels[level];
+        return _texels[l.offset + ((y / TILE_SIZE) * l.tilesPerRow + x / TILE_SIZE) * TILE_SIZE * TILE_SIZE + (y % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE];
+    }
+
+    // Trilinear lookup: bilinear in the two levels around level, blended between them. Texture coordinates repeat outside [0, 1],
+    // and v runs bottom to top as in obj files.
+    Color sample(float u, float v, float level = 0) const;
+
+private:
+    struct Level
+    {
+        uint32_t width, height;
+        uint32_t tilesPerRow;
+        size_t offset;      // First texel of the level in _texels
+    };
+
+    Color sampleBilinear(size_t level, float u, float v) const;
+
+    std::vector<Level> _levels;     // Full size first, then halved until 1x1
+    std::vector<uint32_t> _texels;  // Every level's tiles one after the other, each tile's rows top to bottom
+};
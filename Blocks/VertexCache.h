@@ -0,0 +1,186 @@
+// Reorders a mesh's triangles so that consecutive triangles share vertices, and its vertices so that they are stored in the order they
+// are first used. A renderer that keeps the last few projected vertices around then finds most of them already done, and walking the
+// vertex buffer in index order touches memory front to back instead of jumping around the file order Blender wrote.
+//
+// The triangle order comes from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation": triangles are emitted greedily, always picking
+// the one whose vertices score best, where a vertex scores higher the more recently it was used and the fewer triangles it has left.
+//
+//     float before = computeACMR(triangles);
+//     optimizeVertexCache(vertices, triangles);
+//     float after = computeACMR(triangles);
+#pragma once
+
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <span>
+#include <vector>
+
+constexpr int VERTEX_CACHE_SIZE = 32;
+
+// [comment]
+// Average cache miss ratio: vertices that have to be transformed per triangle, with a least recently used cache of cacheSize vertices.
+// 3 means nothing is ever reused, and well ordered meshes get close to 0.5.
+// [/comment]
+inline float computeACMR(std::span<const int> triangles, int cacheSize = VERTEX_CACHE_SIZE)
+{
+    if (triangles.empty()) { return 0; }
+    std::vector<int> cache;     // Most recently used first
+    size_t misses = 0;
+    for (int index : triangles)
+    {
+        auto found = std::find(cache.begin(), cache.end(), index);
+        if (found == cache.end())
+        {
+            misses++;
+            if ((int)cache.size() == cacheSize) { cache.pop_back(); }
+            cache.insert(cache.begin(), index);
+        } else
+        {
+            std::rotate(cache.begin(), found, found + 1);
+        }
+    }
+    return (float)misses / (triangles.size() / 3);
+}
+
+// [comment]
+// Score of a vertex from its position in the cache (-1 when not in it) and the number of triangles still to be emitted that use it.
+// The 3 vertices of the last triangle get a fixed score so the next triangle doesn't just reuse the same edge forever,
+// and vertices with few triangles left get a boost so they get finished off instead of leaving lone triangles for later.
+// [/comment]
+inline float vertexCacheScore(int cachePosition, int remaining)
+{
+    if (remaining == 0) { return -1; }
+    float score = 0;
+    if (cachePosition >= 3)
+    {
+        score = std::pow(1 - (float)(cachePosition - 3) / (VERTEX_CACHE_SIZE - 3), 1.5f);
+    } else if (cachePosition >= 0)
+    {
+        score = 0.75f;
+    }
+    return score + 2 / std::sqrt((float)remaining);
+}
+
+// [comment]
+// Reorders triangles for vertex cache reuse, then the vertices to the order the new triangles first use them (unused vertices go last).
+// Indices are rewritten to match, so the mesh draws exactly as before. If triangleOrder is given, it gets the old index of every
+// triangle in the new order, for moving any per triangle or per corner data along with them.
+// [/comment]
+template<typename Vertices>
+void optimizeVertexCache(Vertices &vertices, std::span<int> triangles, std::vector<int> *triangleOrder = nullptr)
+{
+    PROFILE_SCOPE("vertex_cache");
+    size_t vertexCount = vertices.size();
+    size_t triangleCount = triangles.size() / 3;
+    if (triangleCount == 0) { return; }
+
+    // Indices after the last whole triangle aren't part of any triangle and are ignored. A list with an index outside the vertices is
+    // left untouched, as its vertices can't be looked up: callers drop such triangles first, as Mesh::load and SceneObject do.
+    triangles = triangles.first(triangleCount * 3);
+    if (std::any_of(triangles.begin(), triangles.end(), [vertexCount](int index) { return index < 0 || (size_t)index >= vertexCount; }))
+    {
+        for (size_t t{0}; triangleOrder && t < triangleCount; ++t) { triangleOrder->push_back((int)t); }
+        return;
+    }
+
+    // Triangles using each vertex. The first remaining[v] entries of a vertex's list are the ones not emitted yet.
+    std::vector<int> remaining(vertexCount, 0);
+    for (int index : triangles) { remaining[index]++; }
+    std::vector<size_t> firstAdjacent(vertexCount + 1, 0);
+    for (size_t v{0}; v < vertexCount; ++v) { firstAdjacent[v + 1] = firstAdjacent[v] + remaining[v]; }
+    std::vector<int> adjacent(firstAdjacent[vertexCount]);
+    {
+        std::vector<size_t> fill(firstAdjacent.begin(), firstAdjacent.end() - 1);
+        for (size_t t{0}; t < triangleCount; ++t)
+        {
+            for (int c{0}; c < 3; ++c) { adjacent[fill[triangles[t * 3 + c]]++] = (int)t; }
+        }
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for (size_t v{0}; v < vertexCount; ++v) { vertexScore[v] = vertexCacheScore(-1, remaining[v]); }
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    int best = 0;
+    for (size_t t{0}; t < triangleCount; ++t)
+    {
+        triangleScore[t] = vertexScore[triangles[t * 3]] + vertexScore[triangles[t * 3 + 1]] + vertexScore[triangles[t * 3 + 2]];
+        if (triangleScore[t] > triangleScore[best]) { best = (int)t; }
+    }
+
+    std::vector<int> order;
+    order.reserve(triangles.size());
+    std::vector<int> cache, nextCache;      // Most recently used first, can briefly hold 3 more than the cache size
+    size_t nextUnemitted = 0;               // Where to look for a triangle when none touch the cache
+    while (order.size() < triangles.size())
+    {
+        if (best < 0)
+        {
+            while (emitted[nextUnemitted]) { ++nextUnemitted; }
+            best = (int)nextUnemitted;
+        }
+
+        // Emit the best triangle, taking it off the lists of its vertices
+        const int *corners = &triangles[best * 3];
+        emitted[best] = true;
+        if (triangleOrder) { triangleOrder->push_back(best); }
+        nextCache.assign(corners, corners + 3);
+        for (int c{0}; c < 3; ++c)
+        {
+            int v = corners[c];
+            order.push_back(v);
+            int *list = &adjacent[firstAdjacent[v]];
+            std::swap(*std::find(list, list + remaining[v], best), list[remaining[v] - 1]);
+            remaining[v]--;
+        }
+
+        // Its vertices move to the front of the cache, pushing the oldest out of it
+        for (int v : cache)
+        {
+            if (v != corners[0] && v != corners[1] && v != corners[2]) { nextCache.push_back(v); }
+        }
+        for (size_t i{0}; i < nextCache.size(); ++i)
+        {
+            int v = nextCache[i];
+            cachePosition[v] = i < VERTEX_CACHE_SIZE ? (int)i : -1;
+            vertexScore[v] = vertexCacheScore(cachePosition[v], remaining[v]);
+        }
+        if (nextCache.size() > VERTEX_CACHE_SIZE) { nextCache.resize(VERTEX_CACHE_SIZE); }
+        std::swap(cache, nextCache);
+
+        // Only triangles touching the cache changed score, and the next one is picked among them
+        best = -1;
+        float bestScore = -1;
+        for (int v : cache)
+        {
+            for (size_t a{firstAdjacent[v]}; a < firstAdjacent[v] + remaining[v]; ++a)
+            {
+                int t = adjacent[a];
+                triangleScore[t] = vertexScore[triangles[t * 3]] + vertexScore[triangles[t * 3 + 1]] + vertexScore[triangles[t * 3 + 2]];
+                if (triangleScore[t] > bestScore)
+                {
+                    best = t;
+                    bestScore = triangleScore[t];
+                }
+            }
+        }
+    }
+
+    // Vertices in order of first use
+    std::vector<int> newIndex(vertexCount, -1);
+    int next = 0;
+    for (int &index : order)
+    {
+        if (newIndex[index] < 0) { newIndex[index] = next++; }
+        index = newIndex[index];
+    }
+    for (int &index : newIndex)
+    {
+        if (index < 0) { index = next++; }
+    }
+    std::vector<typename Vertices::value_type> old(vertices.begin(), vertices.end());
+    for (size_t v{0}; v < vertexCount; ++v) { vertices[newIndex[v]] = old[v]; }
+    std::copy(order.begin(), order.end(), triangles.begin());
+}
@@ -1,11 +1,154 @@
 #include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
 #include "Camera.h"
 #include "SceneObject.h"
+#include "Renderer.h"
+#include "Instancing.h"
+#include "SceneGraph.h"
+#include "Morton.h"
+#include "JobSystem.h"
+#include "LiveScene.h"
+#include "Profiler.h"
+#include <chrono>
+
+// [comment]
+// Live preview: keeps re-rendering the close up to blocks1.svg as blocks.obj is edited, until interrupted.
+// Only the objects whose records changed are parsed again.
+// [/comment]
+static int watch(const Camera& camera)
+{
+    LiveScene scene;
+    renderScene(camera, *scene.getObjects(), "blocks1.svg");
+    std::cout << "Watching " << OBJ_FILE << ", " << scene.getObjects()->size() << " objects" << std::endl;
+    while (true)
+    {
+        if (!scene.waitForChange()) { continue; }
+        auto start = std::chrono::steady_clock::now();
+        size_t changed = scene.reload();
+        renderScene(camera, *scene.getObjects(), "blocks1.svg");
+        double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Reloaded " << changed << " of " << scene.getObjects()->size() << " objects and rendered in " << milliseconds << " ms" << std::endl;
+    }
+}
 
 int main(int argc, char const *argv[])
 {
-    SceneObject floor("Floor");
-    floor.print();
-    
+    // Optionally lay out vertices and objects along a Morton curve, before any other option: ./blocks --morton [--lods <file>]
+    bool morton = argc > 1 && std::string(argv[1]) == "--morton";
+    if (morton)
+    {
+        argc--;
+        argv++;
+    }
+
+    // Close up, where every object is drawn at full detail
+    Camera closeUp(50, 36, 24, 0.1, 100, Vec3f(0, 3, 9), Vec3f(-15, 0, 0));
+    if (argc == 2 && std::string(argv[1]) == "--watch")
+    {
+        return watch(closeUp);
+    }
+
+    // Loading, LOD building and rendering all share the job system's workers
+    JobSystem& jobs = JobSystem::instance();
+    std::vector<SceneObject> objects = SceneObject::loadAll();
+    if (morton)
+    {
+        for (SceneObject& object : objects)
+        {
+            object.sortVerticesMorton();
+        }
+        sortObjectsMorton(objects);
+    }
+
+    if (argc == 3 && std::string(argv[1]) == "--build-lods")
+    {
+        // Offline: write the LOD chain of every object to a separate obj file, e.g. ./blocks --build-lods blocks_lod.obj
+        jobs.parallelFor(objects.size(), 1, [&](size_t begin, size_t end)
+        {
+            for (size_t i{begin}; i < end; ++i) { objects[i].buildLODs(); }
+        });
+        std::ofstream ofs(argv[2]);
+        int vertexOffset = 0;
+        for (SceneObject& object : objects)
+        {
+            object.getLODs().save(ofs, object.getName(), vertexOffset);
+        }
+        return 0;
+    }
+
+    jobs.parallelFor(objects.size(), 1, [&](size_t begin, size_t end)
+    {
+        for (size_t i{begin}; i < end; ++i)
+        {
+            if (argc == 3 && std::string(argv[1]) == "--lods")
+            {
+                // Use a chain built offline
+                objects[i].loadLODs(argv[2]);
+            } else
+            {
+                // Build the chain on load
+                objects[i].buildLODs();
+            }
+        }
+    });
+    for (const SceneObject& object : objects)
+    {
+        std::cout << object.getName() << ": " << object.getLODs().size() << " levels, " << object.getTriangles().size() / 3 << " triangles at full detail, vertex cache miss ratio "
+                  << object.getFileACMR() << " in file order, " << object.getOptimizedACMR() << " reordered" << std::endl;
+    }
+
+    renderScene(closeUp, objects, "blocks1.svg");
+
+    // Wide shot from far away, where the distant objects switch to their simplified levels
+    Camera wide(50, 36, 24, 0.1, 500, Vec3f(0, 30, 180), Vec3f(-10, 0, 0));
+    renderScene(wide, objects, "blocks2.svg");
+
+    // Up close behind the cylinder, which hides the blocks: with occlusion culling they are skipped rather than drawn over
+    Camera behind(50, 36, 24, 0.1, 100, Vec3f(1, 1, 3.3), Vec3f(0, 0, 0));
+    size_t drawn = renderScene(behind, objects, "blocks5.svg", 512, 512, true);
+    std::cout << "Behind the cylinder: " << drawn << " of " << objects.size() << " objects drawn, the rest occluded" << std::endl;
+
+    // Same close up, with the identical blocks sharing one copy of their geometry.
+    // The renderer keeps every object's svg group for the edits below.
+    InstancedScene scene(objects);
+    scene.buildLODs();
+    std::cout << scene.getInstanceCount() << " objects share " << scene.getMeshes().size() << " meshes" << std::endl;
+    SceneRenderer renderer;
+    renderer.render(closeUp, scene, "blocks3.svg");
+
+    // Put the instances in a hierarchy: the blocks hang off a "Stack" node, so turning it turns all three of them
+    SceneGraph graph;
+    int root = graph.addNode("Scene");
+    int stack = graph.addNode("Stack", root);
+    std::vector<int> nodes;
+    for (size_t i{0}; i < scene.getInstanceCount(); ++i)
+    {
+        bool isBlock = scene.getNames()[i].rfind("Block", 0) == 0;
+        nodes.push_back(graph.addNode(scene.getNames()[i], isBlock ? stack : root, scene.getTransform(i)));
+    }
+    graph.update();
+
+    Matrix44f turn
+    {
+        0.866f, 0, -0.5f, 0,
+        0, 1, 0, 0,
+        0.5f, 0, 0.866f, 0,
+        0, 0, 0, 1
+    };
+    graph.setLocal(stack, turn);
+    std::cout << graph.update() << " of " << graph.size() << " nodes recomputed after turning the stack" << std::endl;
+    for (size_t i{0}; i < nodes.size(); ++i)
+    {
+        scene.setTransform(i, graph.getWorld(nodes[i]));
+    }
+    size_t regenerated = renderer.render(closeUp, scene, "blocks4.svg");
+    std::cout << regenerated << " of " << scene.getInstanceCount() << " svg groups regenerated" << std::endl;
+
+    // Only written when built with -DENABLE_PROFILING. The workers are stopped first so their timings are in it.
+    jobs.shutdown();
+    PROFILE_REPORT("profile.json");
+
     return 0;
 }
@@ -0,0 +1,255 @@
+// [comment]
+// End to end scaling benchmark. Generates synthetic meshes of increasing size, writes them in the vertices file format, then times
+// the full pipeline on them: loading, projecting and emitting svg text (with 1 to N threads), and writing the result to disk.
+// Each mesh is also projected once into a NullSink, which times the geometry alone, and rendered once as depth sorted filled polygons.
+//
+// Usage: ./benchmark [max triangles] [max threads]
+// Defaults to 10^6 triangles and every hardware thread. Sizes go up by factors of 10 from 10^4, so 10^8 takes several GB of disk and memory.
+// [/comment]
+#include "renderer.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <sys/resource.h>
+
+// Synthetic geometry, in the same shape as a loaded Mesh but generated in memory
+struct SyntheticObject
+{
+    std::vector<Vec3f> vertices;
+    std::vector<int> triangles;     // Indices relative to this object's vertices
+};
+
+// [comment]
+// Sphere made by subdividing an icosahedron until it has at least targetTriangles triangles (20 * 4^n).
+// [/comment]
+std::vector<SyntheticObject> makeSphere(size_t targetTriangles)
+{
+    const float t = (1 + std::sqrt(5.0f)) / 2;
+    SyntheticObject sphere;
+    sphere.vertices = {{-1, t, 0}, {1, t, 0}, {-1, -t, 0}, {1, -t, 0}, {0, -1, t}, {0, 1, t},
+                       {0, -1, -t}, {0, 1, -t}, {t, 0, -1}, {t, 0, 1}, {-t, 0, -1}, {-t, 0, 1}};
+    sphere.triangles = {0, 11, 5, 0, 5, 1, 0, 1, 7, 0, 7, 10, 0, 10, 11, 1, 5, 9, 5, 11, 4, 11, 10, 2, 10, 7, 6, 7, 1, 8,
+                        3, 9, 4, 3, 4, 2, 3, 2, 6, 3, 6, 8, 3, 8, 9, 4, 9, 5, 2, 4, 11, 6, 2, 10, 8, 6, 7, 9, 8, 1};
+
+    while (sphere.triangles.size() / 3 < targetTriangles)
+    {
+        // Split every triangle in 4, sharing the new midpoint vertices between neighbours
+        std::map<std::pair<int, int>, int> midpoints;
+        auto midpoint = [&](int a, int b)
+        {
+            std::pair<int, int> key = {std::min(a, b), std::max(a, b)};
+            auto found = midpoints.find(key);
+            if (found != midpoints.end()) { return found->second; }
+            sphere.vertices.push_back((sphere.vertices[a] + sphere.vertices[b]) * 0.5f);
+            return midpoints[key] = (int)sphere.vertices.size() - 1;
+        };
+
+        std::vector<int> triangles;
+        triangles.reserve(sphere.triangles.size() * 4);
+        for (size_t i{0}; i < sphere.triangles.size(); i += 3)
+        {
+            int a = sphere.triangles[i], b = sphere.triangles[i + 1], c = sphere.triangles[i + 2];
+            int ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+            triangles.insert(triangles.end(), {a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca});
+        }
+        sphere.triangles = std::move(triangles);
+    }
+
+    // Radius 1.5, sitting where the headphones are
+    for (Vec3f &v : sphere.vertices)
+    {
+        v = v.normalize() * 1.5f + Vec3f(0, 0, 1.5f);
+    }
+    return {std::move(sphere)};
+}
+
+// [comment]
+// Flat n x n grid of quads, two triangles each, with n picked to give about targetTriangles triangles.
+// [/comment]
+std::vector<SyntheticObject> makeGrid(size_t targetTriangles)
+{
+    size_t n = std::max<size_t>(1, (size_t)std::sqrt(targetTriangles / 2.0));
+    SyntheticObject grid;
+    grid.vertices.reserve((n + 1) * (n + 1));
+    grid.triangles.reserve(n * n * 6);
+    for (size_t j{0}; j <= n; ++j)
+    {
+        for (size_t i{0}; i <= n; ++i)
+        {
+            grid.vertices.emplace_back(-2 + 4.0f * i / n, -2 + 4.0f * j / n, 0);
+        }
+    }
+    for (size_t j{0}; j < n; ++j)
+    {
+        for (size_t i{0}; i < n; ++i)
+        {
+            int a = (int)(j * (n + 1) + i), b = a + 1, c = a + (int)n + 1, d = c + 1;
+            grid.triangles.insert(grid.triangles.end(), {a, b, d, a, d, c});
+        }
+    }
+    return {std::move(grid)};
+}
+
+// [comment]
+// Field of separate boxes (12 triangles each, like the headphones' parts), one object per box, laid out on a square grid.
+// [/comment]
+std::vector<SyntheticObject> makeBlockField(size_t targetTriangles)
+{
+    // Same connectivity as the headphones' body
+    const std::vector<int> box = {5, 7, 1, 5, 0, 1, 7, 6, 2, 3, 4, 5, 2, 6, 0, 2, 7, 3, 6, 4, 4, 0, 3, 1, 2, 4, 7, 2, 5, 6, 7, 1, 3, 0, 1, 4};
+    size_t count = std::max<size_t>(1, targetTriangles / 12);
+    size_t side = (size_t)std::ceil(std::sqrt((double)count));
+    float spacing = 4.0f / side, size = spacing * 0.35f;
+
+    std::vector<SyntheticObject> blocks(count);
+    for (size_t b{0}; b < count; ++b)
+    {
+        Vec3f center(-2 + spacing * (b % side + 0.5f), -2 + spacing * (b / side + 0.5f), size);
+        for (int corner{0}; corner < 8; ++corner)
+        {
+            blocks[b].vertices.push_back(center + Vec3f(corner & 4 ? -size : size, corner & 2 ? -size : size, corner & 1 ? -size : size));
+        }
+        blocks[b].triangles = box;
+    }
+    return blocks;
+}
+
+// Write objects in the format Mesh::load reads
+void writeVerticesFile(const std::vector<SyntheticObject> &objects, std::string filename)
+{
+    std::ofstream ofs(filename);
+    for (size_t o{0}; o < objects.size(); ++o)
+    {
+        ofs << "Selected Object: Object " << o << "\n\nArray of vertices:\n";
+        for (const Vec3f &v : objects[o].vertices)
+        {
+            ofs << v.x << " " << v.y << " " << v.z << "\n";
+        }
+        ofs << "Array of connected vertices:\n";
+        for (int index : objects[o].triangles)
+        {
+            ofs << index << " ";
+        }
+        ofs << "\n\n";
+    }
+}
+
+// Largest resident set size of the process so far, in MB
+double peakRSS()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char const *argv[])
+{
+    size_t maxTriangles = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    unsigned maxThreads = argc > 2 ? (unsigned)std::atoi(argv[2]) : std::max(1u, std::thread::hardware_concurrency());
+
+    // Camera of Ex. 1, which frames everything the generators make
+    Matrix44f cameraToWorld = getCameraToWorld(77, 0, 5, 0.5, -9, 3.5);
+    Matrix44f worldToCamera = cameraToWorld.inverse();
+    const std::string input = "benchmark_input.txt", output = "benchmark_output.svg";
+
+    struct Generator { const char *name; std::vector<SyntheticObject> (*make)(size_t); };
+    const Generator generators[] = {{"sphere", makeSphere}, {"grid", makeGrid}, {"blocks", makeBlockField}};
+
+    std::printf("%-8s %12s %8s %10s %10s %10s %12s %8s %10s %10s %10s\n",
+                "mesh", "triangles", "threads", "load ms", "render ms", "write ms", "Mtris/s", "speedup", "efficiency", "peak MB", "output MB");
+
+    for (size_t target{10000}; target <= maxTriangles; target *= 10)
+    {
+        for (const Generator &generator : generators)
+        {
+            writeVerticesFile(generator.make(target), input);
+
+            Mesh mesh;
+            auto start = std::chrono::steady_clock::now();
+            if (!mesh.load(input)) { return 1; }
+            double loadTime = millisecondsSince(start);
+            size_t triangleCount = mesh.triangles.size() / 3;
+
+            double singleThreaded = 0;
+            unsigned brokeDownAt = 0;
+            for (unsigned threads{1}; threads <= maxThreads; threads *= 2)
+            {
+                // Every thread gets its own context (so its own memory pool and text buffer) and an even share of the triangles
+                std::vector<std::unique_ptr<RenderContext>> contexts;
+                for (unsigned t{0}; t < threads; ++t)
+                {
+                    contexts.push_back(std::make_unique<RenderContext>(50, 35, 24, 0.1, 100, cameraToWorld, output));
+                }
+
+                start = std::chrono::steady_clock::now();
+                std::vector<std::thread> workers;
+                for (unsigned t{0}; t < threads; ++t)
+                {
+                    size_t first = triangleCount * t / threads, last = triangleCount * (t + 1) / threads;
+                    workers.emplace_back([&, t, first, last]() { projectTriangles(mesh, *contexts[t], worldToCamera, first, last - first, contexts[t]->svg); });
+                }
+                for (std::thread &worker : workers)
+                {
+                    worker.join();
+                }
+                double renderTime = millisecondsSince(start);
+
+                start = std::chrono::steady_clock::now();
+                std::ofstream ofs(output);
+                ofs << "<svg version=\"1.1\" xmlns:xlink=\"http://www.w3.org/1999/xlink\" xmlns=\"http://www.w3.org/2000/svg\" width=\"512\" height=\"512\">\n";
+                for (const auto &context : contexts)
+                {
+                    ofs.write(context->svg.data(), context->svg.size());
+                }
+                ofs << "</svg>\n";
+                double outputSize = (double)ofs.tellp() / (1 << 20);
+                ofs.close();
+                double writeTime = millisecondsSince(start);
+
+                if (threads == 1) { singleThreaded = renderTime; }
+                double speedup = singleThreaded / renderTime;
+                double efficiency = speedup / threads;
+                // Adding threads stops paying off once each one is doing less than half its share of useful work
+                if (efficiency < 0.5 && brokeDownAt == 0) { brokeDownAt = threads; }
+
+                std::printf("%-8s %12zu %8u %10.2f %10.2f %10.2f %12.2f %8.2f %10.2f %10.1f %10.1f\n",
+                            generator.name, triangleCount, threads, loadTime, renderTime, writeTime,
+                            triangleCount / renderTime / 1000, speedup, efficiency, peakRSS(), outputSize);
+            }
+
+            // Projection alone, into a sink that only counts: the difference from the render time above is the cost of the svg text
+            RenderContext projectionOnly(50, 35, 24, 0.1, 100, cameraToWorld, output);
+            NullSink nullSink;
+            start = std::chrono::steady_clock::now();
+            renderObject(mesh, projectionOnly, nullSink);
+            double projectionTime = millisecondsSince(start);
+            std::printf("%-8s %12zu projection alone in %.2f ms (%.2f Mtris/s), %zu triangles visible\n",
+                        generator.name, triangleCount, projectionTime, triangleCount / projectionTime / 1000, nullSink.visibleCount);
+
+            // Filled polygons, on every hardware thread: projection, depth sort and svg output together.
+            // Build with -DENABLE_PROFILING to see how much of it the sort takes.
+            RenderContext filled(50, 35, 24, 0.1, 100, cameraToWorld, output);
+            filled.mode = RenderMode::Filled;
+            start = std::chrono::steady_clock::now();
+            projectObject(mesh, filled, worldToCamera, filled.svg);
+            std::printf("%-8s %12zu filled polygons rendered in %.2f ms\n", generator.name, triangleCount, millisecondsSince(start));
+
+            if (brokeDownAt)
+            {
+                std::printf("%-8s %12zu scaling breaks down at %u threads (efficiency below 50%%)\n", generator.name, triangleCount, brokeDownAt);
+            }
+        }
+    }
+
+    std::filesystem::remove(input);
+    std::filesystem::remove(output);
+    return 0;
+}
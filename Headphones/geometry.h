@@ -28,6 +28,8 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //[/ignore]
+#pragma once
+
 #include <cstdlib>
 #include <cstdint>
 #include <cstdio>
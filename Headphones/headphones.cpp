@@ -1,301 +1,188 @@
-#include "geometry.h"
+#include "renderer.h"
+#include "server.h"
+#include "progressive.h"
+#include <cmath>
 #include <cstdlib>
-#include <fstream>
-#include <sstream>
 #include <iostream>
+#include <string>
+#include <thread>
 #include <vector>
+#include <new>
+#include <numbers>
 
-bool readVerticesFile(std::string filename);
+#ifdef COUNT_ALLOCATIONS
+// Build with -DCOUNT_ALLOCATIONS to count every allocation made through the general purpose heap
+std::atomic<size_t> allocationCount{0};
 
-bool computeCoordinates
-(
-    const Vec3f &pWorld,            
-    const Matrix44f &worldToCamera, 
-    const float &b,                 
-    const float &l,
-    const float &t,
-    const float &r,
-    const float &near,              
-    const uint32_t &imageWidth,     
-    const uint32_t &imageHeight,
-    Vec2i &pRaster                  
-);
-
-void renderObject
-(
-    float fLength,              
-    float fAW,                  
-    float fAH,                  
-    float nCP,                  
-    float fCP,                  
-    Matrix44f cameraToWorld,    
-    std::string filename        
-);
-
-Matrix44f getCameraToWorld(float s1, float s2, float s3, float x, float y, float z);
-
-// Two vectors, one to store all vertex coordinates, and the other to store which indices of vertices in the vertices vector are linked together to make a triangle
-std::vector<Vec3f> vertices;
-std::vector<int> triangles;
-
-// Float casts for trig functions
-float cosf(float angle) { return (float)(cos(angle * std::numbers::pi/180)); }
-float sinf(float angle) { return (float)(sin(angle * std::numbers::pi/180)); }
+// Every replaceable form is replaced, so no new is ever paired with a library delete or the other way round. The others forward to
+// these two, which aren't inlined: inlined, the compiler would see malloc and free in place of new and delete and flag them as mismatched.
+[[gnu::noinline]] void *operator new(size_t size)
+{
+    allocationCount++;
+    if (void *p = std::malloc(size)) { return p; }
+    throw std::bad_alloc();
+}
+void *operator new(size_t size, std::align_val_t alignment)
+{
+    allocationCount++;
+    // aligned_alloc wants a size that is a multiple of the alignment
+    size_t align = (size_t)alignment;
+    if (void *p = std::aligned_alloc(align, (size + align - 1) / align * align)) { return p; }
+    throw std::bad_alloc();
+}
+void *operator new[](size_t size) { return operator new(size); }
+void *operator new[](size_t size, std::align_val_t alignment) { return operator new(size, alignment); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    allocationCount++;
+    return std::malloc(size);
+}
+void *operator new[](size_t size, const std::nothrow_t &) noexcept { return operator new(size, std::nothrow); }
+
+[[gnu::noinline]] void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { operator delete(p); }
+void operator delete(void *p, std::align_val_t) noexcept { operator delete(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { operator delete(p); }
+void operator delete[](void *p) noexcept { operator delete(p); }
+void operator delete[](void *p, size_t) noexcept { operator delete(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { operator delete(p); }
+void operator delete[](void *p, size_t, std::align_val_t) noexcept { operator delete(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { operator delete(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { operator delete(p); }
+#endif
 
 int main(int argc, char const *argv[])
 {
-    if (!readVerticesFile("headphones.txt")) 
+    // Render a file too large to load, with the camera of Ex. 1: ./headphones --stream <input> <output>
+    if (argc == 4 && std::string(argv[1]) == "--stream")
+    {
+        RenderContext context(50, 35, 24, 0.1, 100, getCameraToWorld(77, 0, 5, 0.5, -9, 3.5), argv[3]);
+        bool rendered = renderObjectStreamed(context, argv[2]);
+        PROFILE_REPORT("profile.json");
+        return rendered ? 0 : 1;
+    }
+
+    // Ask a running server for a render: ./headphones --request <socket> <focal length> <aperture w> <aperture h> <near> <far> <s1> <s2> <s3> <x> <y> <z> <output>
+    if (argc == 15 && std::string(argv[1]) == "--request")
+    {
+        RenderRequest request;
+        float *parameters[] = {&request.focalLength, &request.filmApertureWidth, &request.filmApertureHeight, &request.nearClippingPlane, &request.farClippingPlane,
+                               &request.s1, &request.s2, &request.s3, &request.x, &request.y, &request.z};
+        for (int i{0}; i < 11; ++i)
+        {
+            *parameters[i] = std::strtof(argv[i + 3], nullptr);
+        }
+        std::string output;
+        if (!requestRender(argv[2], request, output)) { return 1; }
+        std::ofstream(argv[14]).write(output.data(), output.size());
+        return 0;
+    }
+
+    Mesh mesh;
+    if (!mesh.load("headphones.txt")) 
     {
         return 1;
     }
+    std::cout << "Vertex cache miss ratio: " << mesh.fileACMR << " in file order, " << mesh.optimizedACMR << " reordered" << std::endl;
+
+    // Keep the mesh loaded and render for requests on a Unix socket: ./headphones --serve <socket> [workers] [cache directory]
+    // Renders are cached in memory, and also in the directory if one is given so they outlive the server.
+    if (argc >= 3 && argc <= 5 && std::string(argv[1]) == "--serve")
+    {
+        unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+        if (argc >= 4)
+        {
+            char *end;
+            unsigned long count = std::strtoul(argv[3], &end, 10);
+            if (end == argv[3] || *end != '\0' || count < 1 || count > 4096 || argv[3][0] == '-')
+            {
+                std::cerr << "Worker count must be a number from 1 to 4096, not " << argv[3] << std::endl;
+                return 1;
+            }
+            workers = (unsigned)count;
+        }
+        RenderCache cache(256 << 20, argc == 5 ? argv[4] : "");
+        return serveRenders(mesh, argv[2], cache, workers) ? 0 : 1;
+    }
 
     // Ex. 1
     // Camera is placed at (0.5, -9, 3.5), rotated 77deg around X and 5deg around Z.
-    renderObject(50, 35, 24, 0.1, 100, getCameraToWorld(77, 0, 5, 0.5, -9, 3.5), "./headphones1.svg");
+    RenderContext ex1(50, 35, 24, 0.1, 100, getCameraToWorld(77, 0, 5, 0.5, -9, 3.5), "./headphones1.svg");
 
     // Ex. 2
     // Camera looks from below the object
-    renderObject(48, 35, 24, 0.1, 100, getCameraToWorld(113, 30, 39, 5.3, -10, -2.75), "./headphones2.svg");
+    RenderContext ex2(48, 35, 24, 0.1, 100, getCameraToWorld(113, 30, 39, 5.3, -10, -2.75), "./headphones2.svg");
 
     // Ex. 3
     // Camera is zoomed out (focal length is smaller)
-    renderObject(17, 35, 24, 0.1, 100, getCameraToWorld(67.2, 0, -24, -3.3, -6, 5), "./headphones3.svg");
+    RenderContext ex3(17, 35, 24, 0.1, 100, getCameraToWorld(67.2, 0, -24, -3.3, -6, 5), "./headphones3.svg");
 
     // Ex. 4
     // Camera is zoomed in, with some vertices outside of the FOV
-    renderObject(156, 35, 24, 0.1, 100, getCameraToWorld(51, 0, -135, -7.8, 7.5, 10.2), "./headphones4.svg");
-
-    return 0;
-}
-
-// [comment]
-// Reads from a text file generated from Blender that contains all the vertices of a 3D object and how they are connected to each other. 
-// Stores the vertices in a vertices vector, and which points are connected to each other in a triangle vector
+    RenderContext ex4(156, 35, 24, 0.1, 100, getCameraToWorld(51, 0, -135, -7.8, 7.5, 10.2), "./headphones4.svg");
 
-// Text file should have the form:
-// vertex Flag:
-// x1 x2 x3
-// x1 x2 x3
-// ...
-// x1 x2 x3
-// connection Flag:
-// a b c ...
+    // Shaded polygons instead of the wireframe: ./headphones --filled writes headphones1_filled.svg, ...
+    bool filled = argc == 2 && std::string(argv[1]) == "--filled";
 
-// [/comment]
-
-bool readVerticesFile(std::string filename)
-{
-    std::ifstream inputFile(filename);
+    // Turntable, only rendered on request: ./headphones --turntable <frames>
+    bool turntable = argc == 3 && std::string(argv[1]) == "--turntable";
 
-    if (inputFile.is_open())
-    {   
-        std::string line;
-        bool readingVertices;
-        bool readingTris;
-        int vertexCount = 0;
+    // Progressive render of Ex. 1 within a time budget, as an interactive viewer would show it: ./headphones --progressive <budget ms>
+    bool progressive = argc == 3 && std::string(argv[1]) == "--progressive";
 
-        while (std::getline(inputFile, line))
+    // The four examples are only drawn when no other output was asked for, so the modes below don't overwrite them
+    if (!turntable && !progressive)
+    {
+        // The four renders share the mesh but nothing else, so they can all run at once
+        std::vector<std::thread> renders;
+        for (RenderContext *context : {&ex1, &ex2, &ex3, &ex4})
         {
-            if (line == "Array of vertices:")
-            {
-                readingVertices = true;
-            } else if (line == "Array of connected vertices:")
-            {
-                readingTris = true;
-            } 
-            else if (readingVertices)
-            {
-                // Read next 8 lines, each containing 3 floats
-                std::stringstream ss(line);
-                float x, y, z;
-                ss >> x >> y >> z;
-                Vec3f vertex = {x,y,z};
-                vertices.push_back(vertex);
-                vertexCount++;
-                if (vertexCount % 8 == 0) { readingVertices = false; }
-            } else if (readingTris)
+            if (filled)
             {
-                // Read next line
-                std::stringstream ss(line);
-                int index;
-                while (ss >> index) 
-                { 
-                    // indices in text file are relative to the object's vertices, not the entire list.
-                    index += 8*((vertexCount/8) - 1);
-                    triangles.push_back(index);
-                }
-                readingTris = false;
-            } else 
-            {
-                continue;
+                context->mode = RenderMode::Filled;
+                context->filename.insert(context->filename.size() - 4, "_filled");
             }
+            renders.emplace_back([&mesh, context]() { renderObject(mesh, *context); });
+        }
+        for (std::thread &render : renders)
+        {
+            render.join();
         }
-        return 1;
-    } else {
-        std::cerr << "Could not open file";
-        return 0;
     }
-}
-
-// [comment]
-// Get a cameraToWorld matrix, which is defined to be how the camera's transformation can be described relative to global coordinates.
-// Used to calculate coordinates in the screen space before converting to raster space.
-// First 3 parameters are rotations around x, y, and z axes respectively, and the next three describe the translation of the camera.
-// Parameters should be taken from Blender Camera settings to replicate
-// [/comment]
-Matrix44f getCameraToWorld(float s1, float s2, float s3, float x, float y, float z)
-{
-    // Rotation around X
-    Matrix44f rotx = 
-    {
-        1, 0, 0, 0,
-        0, cosf(s1), sinf(s1), 0,
-        0, -sinf(s1), cosf(s1), 0,
-        0, 0, 0, 1
-    };
 
-    // Rotation around Y (Negative because x-axis points in opposite direction than convenetional when looking down the y-axis)
-    Matrix44f roty = 
+    // Camera circles the object at the height and distance of Ex. 1, with a keyframe every 30deg.
+    if (turntable)
     {
-        cosf(-s2), 0, sinf(-s2), 0,
-        0, 1, 0, 0,
-        -sinf(-s2), 0, cosf(-s2), 0,
-        0, 0, 0, 1
-    };
-
-    // Rotation around Z
-    Matrix44f rotz = 
-    {
-       cosf(s3), sinf(s3), 0, 0,
-       -sinf(s3), cosf(s3), 0, 0, 
-       0, 0, 1, 0,
-       0, 0, 0, 1 
-    };
+        std::vector<CameraKeyframe> keyframes;
+        int frameCount = std::atoi(argv[2]);
+        for (int angle{0}; angle <= 360; angle += 30)
+        {
+            float frame = angle / 360.0f * frameCount;
+            double radians = angle * std::numbers::pi / 180;
+            keyframes.push_back({frame, 77, 0, (float)angle, 9 * (float)std::sin(radians), -9 * (float)std::cos(radians), 3.5});
+        }
+        RenderContext turntable(50, 35, 24, 0.1, 100, Matrix44f(), "./turntable_");
+        renderAnimation(mesh, turntable, keyframes, frameCount);
+    }
 
-    // Translation to (x,y,z)
-    Matrix44f translation = 
+    // Writes the last pass to headphones1_progressive.svg.
+    if (progressive)
     {
-        1, 0, 0, 0,
-        0, 1, 0, 0,
-        0, 0, 1, 0,
-        x, y, z, 1
-    };
-
-    // Compose 3 Rotations and a translation together
-    Matrix44f temp;
-    Matrix44f::multiply(rotx, roty, temp);
-
-    Matrix44f temp2;
-    Matrix44f::multiply(temp, rotz, temp2);
-
-    Matrix44f cameraToWorld;
-    Matrix44f::multiply(temp2, translation, cameraToWorld);
-
-    return cameraToWorld;
-}
-
-// [comment]
-// Function is adapted from https://github.com/scratchapixel/scratchapixel-code/blob/main/3d-viewing-pinhole-camera/pinhole.cpp
-// Used to compute the raster coordinates of a point in the world, returning whether that point is visible or not. 
-// However, it will also assign a Vec2<int> value to the corresponding world coordinate, which can then be drawn.
-// [/comment]
-bool computeCoordinates
-(
-    const Vec3f &pWorld,            // Point in the world to transform to raster space
-    const Matrix44f &worldToCamera, // worldToCamera matrix
-    const float &b,                 // bottom, left, top, and right boundaries of image plane
-    const float &l,
-    const float &t,
-    const float &r,
-    const float &near,              // distance between eye and canvas
-    const uint32_t &imageWidth,     // Dimensions of final image.
-    const uint32_t &imageHeight,
-    Vec2i &pRaster                  // Point in raster space to affect
-)
-{
-    Vec3f pCamera; // Initialized as (0,0,0)
-    worldToCamera.multVecMatrix(pWorld, pCamera); // Transform a point from pWorld into coordinates relative to pCamera.
-    
-    // Screen coordinates
-    Vec2f pScreen;
-    pScreen.x = pCamera.x / -pCamera.z * near;
-    pScreen.y = pCamera.y / -pCamera.z * near;
-    
-    // Normalized Device coordinates
-    Vec2f pNDC;
-    pNDC.x = (pScreen.x + r) / (2 * r);
-    pNDC.y = (pScreen.y + t) / (2 * t);
-
-    // Raster coordinates
-    pRaster.x = (int)(pNDC.x * imageWidth);
-    pRaster.y = (int)((1 - pNDC.y) * imageHeight);
+        RefinementOrder order = buildRefinementOrder(mesh);
+        RenderContext context(50, 35, 24, 0.1, 100, ex1.cameraToWorld, "./headphones1_progressive.svg");
+        auto budget = std::chrono::microseconds((long long)(std::atof(argv[2]) * 1000));
+        renderObjectProgressive(mesh, context, order, budget, [](const std::pmr::string &, const ProgressivePass &pass)
+        {
+            std::cout << "Pass " << pass.pass << ": " << pass.trianglesDrawn << " triangles, " << pass.coverage * 100 << "% of the area, "
+                      << pass.elapsedMs << " ms" << std::endl;
+            return true;
+        });
+        std::ofstream(context.filename).write(context.svg.data(), context.svg.size());
+    }
 
-    // Check if point lies in the screen
-    bool visible = true;
-    if (pScreen.x < l || pScreen.x > r || pScreen.y < b || pScreen.y > t)
-        visible = false;
+    // Only written when built with -DENABLE_PROFILING. The pool's workers are stopped first so their timings are in it.
+    JobSystem::instance().shutdown();
+    PROFILE_REPORT("profile.json");
 
-    return visible;
+    return 0;
 }
-
-// [comment]
-// Code has been adapted from https://github.com/scratchapixel/scratchapixel-code/blob/main/3d-viewing-pinhole-camera/pinhole.cpp
-// Allows user to easily create a render of the object from camera settings they specify. 
-// [/comment]
-void renderObject
-(
-    float fLength,              // Focal Length, mm
-    float fAW,                  // Film Aperture Width, mm
-    float fAH,                  // Film Aperture Height, mm
-    float nCP,                  // Near Clipping Plane, m
-    float fCP,                  // Far Clipping Plane, m
-    Matrix44f cameraToWorld,    // Camera to World matrix, i.e. how has the camera been transformed
-    std::string filename        // Output file name
-)
-{
-    // Settings can be taken from Blender Camera to replicate
-    float focalLength = fLength; 
-    float filmApertureWidth = fAW; 
-    float filmApertureHeight = fAH;
-    float nearClippingPlane = nCP;
-    float farClippingPlane = fCP; 
-
-    Matrix44f worldToCamera = cameraToWorld.inverse();
-
-    // Calculation of Canvas dimensions, based on camera settings.
-    float top = (filmApertureHeight/2)/focalLength * nearClippingPlane;
-    float bottom = -top;
-    float right = (filmApertureWidth/2)/focalLength * nearClippingPlane; 
-    float left = -right;
-
-    // Final Image Dimensions
-    uint32_t imageWidth = 512, imageHeight = 512;
-
-    std::ofstream ofs;
-    ofs.open(filename);
-    ofs << "<svg version=\"1.1\" xmlns:xlink=\"http://www.w3.org/1999/xlink\" xmlns=\"http://www.w3.org/2000/svg\" width=\"" << imageWidth << "\" height=\"" << imageHeight << "\">" << std::endl;
-    for (size_t i{0}; i < triangles.size()/3; ++i)
-    {
-        // Grab 3 vertices that make up a triangle
-        const Vec3f &v0World = vertices[triangles[i * 3]];
-        const Vec3f &v1World = vertices[triangles[i * 3 + 1]];
-        const Vec3f &v2World = vertices[triangles[i * 3 + 2]];
-        Vec2i v0Raster, v1Raster, v2Raster;
-
-        bool visible = true;
-
-        // Visible only if all vertices making up that triangle are in the canvas frame, and assign raster coordinates 
-        visible &= computeCoordinates(v0World, worldToCamera, bottom, left, top, right, nearClippingPlane, imageWidth, imageHeight, v0Raster);
-        visible &= computeCoordinates(v1World, worldToCamera, bottom, left, top, right, nearClippingPlane, imageWidth, imageHeight, v1Raster);
-        visible &= computeCoordinates(v2World, worldToCamera, bottom, left, top, right, nearClippingPlane, imageWidth, imageHeight, v2Raster);
-        
-        int val = visible ? 0 : 255; // Black if visible, red if not visible
-
-        // Draw lines using svg format
-        ofs << "<line x1=\"" << v0Raster.x << "\" y1=\"" << v0Raster.y << "\" x2=\"" << v1Raster.x << "\" y2=\"" << v1Raster.y << "\" style=\"stroke:rgb(" << val << ",0,0);stroke-width:1\" />\n";
-        ofs << "<line x1=\"" << v1Raster.x << "\" y1=\"" << v1Raster.y << "\" x2=\"" << v2Raster.x << "\" y2=\"" << v2Raster.y << "\" style=\"stroke:rgb(" << val << ",0,0);stroke-width:1\" />\n";
-        ofs << "<line x1=\"" << v2Raster.x << "\" y1=\"" << v2Raster.y << "\" x2=\"" << v0Raster.x << "\" y2=\"" << v0Raster.y << "\" style=\"stroke:rgb(" << val << ",0,0);stroke-width:1\" />\n"; 
-    }
-    ofs << "</svg>\n";
-    ofs.close();
-}
\ No newline at end of file
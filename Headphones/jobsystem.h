@@ -0,0 +1,268 @@
+// One pool of worker threads shared by everything in the program that computes in parallel, so concurrent renders split the cores
+// between them instead of each starting a thread per core of its own.
+//
+// Every worker has its own deque of jobs: it pushes and pops at one end without locking, and idle workers steal from the other end.
+// A thread waiting on jobs runs jobs itself in the meantime, which also makes nested parallelism (a job waiting on jobs) safe.
+// Header only copy of the job system in Blocks, without its NUMA placement and task graph.
+//
+//     JobSystem::instance().parallelFor(triangleCount, 4096, [&](size_t begin, size_t end) { ... });
+//
+// Only for work that computes: a job that blocks (on a Channel, a socket or a semaphore) holds on to its worker, and with no workers
+// (a single core) jobs run inline, where a producer waiting for its consumer would wait forever. Pipeline stages (see pipeline.h) and
+// server workers keep threads of their own for that reason.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of jobs of a group still running. run() adds to it and every job takes itself off once done.
+using JobCounter = std::atomic<int>;
+
+class JobSystem
+{
+public:
+    // workerCount 0 means one worker per hardware thread, less one for the thread that submits the work
+    explicit JobSystem(unsigned workerCount = 0)
+    {
+        if (workerCount == 0) { workerCount = std::max(1u, std::thread::hardware_concurrency()) - 1; }
+        for (unsigned w{0}; w < workerCount; ++w)
+        {
+            _deques.push_back(std::make_unique<Deque>());
+        }
+        for (unsigned w{0}; w < workerCount; ++w)
+        {
+            _threads.emplace_back([this, w]() { workerLoop((int)w); });
+        }
+    }
+
+    ~JobSystem() { shutdown(); }
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator = (const JobSystem &) = delete;
+
+    // The system shared by the whole program, created on first use
+    static JobSystem &instance()
+    {
+        static JobSystem jobs;
+        return jobs;
+    }
+
+    void run(std::function<void()> job, JobCounter &counter)
+    {
+        counter++;
+        if (_threads.empty())
+        {
+            job();
+            counter--;
+            return;
+        }
+
+        Job *entry = new Job{std::move(job), &counter};
+        _queued++;
+        if (currentSystem() != this || !_deques[currentWorker()]->push(entry))
+        {
+            std::lock_guard<std::mutex> lock(_injectedMutex);
+            _injected.push_back(entry);
+            _injectedCount++;
+        }
+        // Taking the lock orders this with a worker checking _queued before it goes to sleep, so the wake up can't be missed
+        {
+            std::lock_guard<std::mutex> lock(_sleepMutex);
+        }
+        _wake.notify_one();
+    }
+
+    // Returns once every job of the counter has finished, running jobs on this thread until then
+    void wait(JobCounter &counter)
+    {
+        int worker = currentSystem() == this ? currentWorker() : -1;
+        while (counter > 0)
+        {
+            if (Job *job = findJob(worker))
+            {
+                execute(job);
+            } else
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // Calls body(begin, end) over [0, count) in chunks of grain elements, and returns once all of them are done
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &body)
+    {
+        grain = std::max<size_t>(1, grain);
+        JobCounter counter{0};
+        for (size_t begin{0}; begin < count; begin += grain)
+        {
+            size_t end = std::min(count, begin + grain);
+            run([&body, begin, end]() { body(begin, end); }, counter);
+        }
+        wait(counter);
+    }
+
+    // Finishes the queued jobs and joins the workers, e.g. so their profiling data is merged before a report.
+    // Jobs run after this are run straight away on the calling thread.
+    void shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_sleepMutex);
+            _stopping = true;
+        }
+        _wake.notify_all();
+        for (std::thread &thread : _threads)
+        {
+            thread.join();
+        }
+        _threads.clear();
+    }
+
+    // Threads that run jobs at once: the workers and the thread waiting on them
+    unsigned getThreadCount() const { return (unsigned)_threads.size() + 1; }
+
+private:
+    struct Job
+    {
+        std::function<void()> function;
+        JobCounter *counter;
+    };
+
+    // [comment]
+    // Chase-Lev work stealing deque (Lê, Pop, Cohen and Zappa Nardelli, "Correct and Efficient Work-Stealing for Weak Memory Models", 2013)
+    // with a fixed capacity: push and pop are only called by the owning worker, steal by anyone.
+    // [/comment]
+    class Deque
+    {
+    public:
+        static constexpr int64_t CAPACITY = 4096;
+
+        bool push(Job *job)
+        {
+            int64_t bottom = _bottom.load();
+            if (bottom - _top.load() >= CAPACITY) { return false; }
+            _jobs[bottom % CAPACITY].store(job);
+            _bottom.store(bottom + 1);
+            return true;
+        }
+
+        Job *pop()
+        {
+            int64_t bottom = _bottom.load() - 1;
+            _bottom.store(bottom);
+            int64_t top = _top.load();
+            if (top > bottom)
+            {
+                // Empty
+                _bottom.store(bottom + 1);
+                return nullptr;
+            }
+            Job *job = _jobs[bottom % CAPACITY].load();
+            if (top == bottom)
+            {
+                // Last job, which a thief may be taking at the same time: whoever moves top first gets it
+                if (!_top.compare_exchange_strong(top, top + 1)) { job = nullptr; }
+                _bottom.store(bottom + 1);
+            }
+            return job;
+        }
+
+        Job *steal()
+        {
+            int64_t top = _top.load();
+            int64_t bottom = _bottom.load();
+            if (top >= bottom) { return nullptr; }
+            Job *job = _jobs[top % CAPACITY].load();
+            if (!_top.compare_exchange_strong(top, top + 1)) { return nullptr; }
+            return job;
+        }
+
+    private:
+        std::atomic<int64_t> _top{0}, _bottom{0};
+        std::atomic<Job *> _jobs[CAPACITY];
+    };
+
+    // The system the current thread is a worker of, and its index there (-1 for threads that aren't workers)
+    static const JobSystem *&currentSystem()
+    {
+        static thread_local const JobSystem *system = nullptr;
+        return system;
+    }
+    static int &currentWorker()
+    {
+        static thread_local int worker = -1;
+        return worker;
+    }
+
+    // The worker's own jobs first, then other workers', without taking any lock. Only then the injected queue, and its lock only when
+    // the count says it holds something.
+    Job *findJob(int worker)
+    {
+        Job *job = nullptr;
+        if (worker >= 0) { job = _deques[worker]->pop(); }
+        // Victims starting after this worker, so thieves spread out
+        size_t start = worker >= 0 ? (size_t)worker + 1 : 0;
+        for (size_t i{0}; !job && i < _deques.size(); ++i)
+        {
+            size_t victim = (start + i) % _deques.size();
+            if ((int)victim != worker) { job = _deques[victim]->steal(); }
+        }
+        if (!job && _injectedCount > 0)
+        {
+            std::lock_guard<std::mutex> lock(_injectedMutex);
+            if (!_injected.empty())
+            {
+                job = _injected.front();
+                _injected.pop_front();
+                _injectedCount--;
+            }
+        }
+        if (job) { _queued--; }
+        return job;
+    }
+
+    void execute(Job *job)
+    {
+        job->function();
+        (*job->counter)--;
+        delete job;
+    }
+
+    void workerLoop(int worker)
+    {
+        currentSystem() = this;
+        currentWorker() = worker;
+        while (true)
+        {
+            if (Job *job = findJob(worker))
+            {
+                execute(job);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(_sleepMutex);
+            if (_stopping && _queued == 0) { break; }
+            _wake.wait(lock, [&]() { return _queued > 0 || _stopping; });
+        }
+    }
+
+    std::vector<std::unique_ptr<Deque>> _deques;    // One per worker
+    std::vector<std::thread> _threads;
+
+    // Jobs submitted by threads that aren't workers. The count is read without the lock, to skip it when the queue is empty.
+    std::mutex _injectedMutex;
+    std::deque<Job *> _injected;
+    std::atomic<int> _injectedCount{0};
+
+    // Idle workers sleep until a job is queued
+    std::atomic<int> _queued{0};
+    std::atomic<bool> _stopping{false};
+    std::mutex _sleepMutex;
+    std::condition_variable _wake;
+};
@@ -0,0 +1,126 @@
+// Building blocks for renders written as a chain of stages, each a coroutine that takes the items of the previous stage and yields its own:
+//
+//     Generator<Batch> project(Generator<Batch> batches) { for (Batch &batch : batches) { ...; co_yield std::move(batch); } }
+//
+// Stages chained directly run on one thread, each pulling from the one before. A Channel between two stages lets them run on different
+// threads: the producer blocks once the channel holds its capacity, so a fast stage can never run ahead of a slow one by more than that.
+#pragma once
+
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+
+// [comment]
+// Lazily produces a sequence of T with co_yield, to be consumed with a range for. The coroutine only runs while the consumer asks for
+// the next item, on the consumer's thread. Yielded items may be moved from by the consumer.
+// [/comment]
+template<typename T>
+class Generator
+{
+public:
+    struct promise_type
+    {
+        T *current = nullptr;
+
+        Generator get_return_object() { return Generator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        // The yielded object lives until the coroutine resumes, so pointing at it is enough
+        std::suspend_always yield_value(T &value) noexcept { current = std::addressof(value); return {}; }
+        std::suspend_always yield_value(T &&value) noexcept { current = std::addressof(value); return {}; }
+        void return_void() {}
+        void unhandled_exception() { throw; }
+    };
+
+    struct iterator
+    {
+        std::coroutine_handle<promise_type> handle;
+
+        iterator &operator ++ () { handle.resume(); return *this; }
+        T &operator * () const { return *handle.promise().current; }
+        bool operator == (std::default_sentinel_t) const { return handle.done(); }
+    };
+
+    Generator(Generator &&other) noexcept : _handle(std::exchange(other._handle, nullptr)) {}
+    Generator &operator = (Generator &&other) noexcept { std::swap(_handle, other._handle); return *this; }
+    ~Generator() { if (_handle) { _handle.destroy(); } }
+
+    iterator begin() { _handle.resume(); return {_handle}; }
+    std::default_sentinel_t end() { return {}; }
+
+private:
+    explicit Generator(std::coroutine_handle<promise_type> handle) : _handle(handle) {}
+    std::coroutine_handle<promise_type> _handle;
+};
+
+// [comment]
+// Bounded queue connecting a stage on one thread to a stage on another. push blocks while the channel is full, pop while it is empty,
+// and once the producer closes it, pop returns nothing after the last item.
+// [/comment]
+template<typename T>
+class Channel
+{
+public:
+    explicit Channel(size_t capacity) : _capacity(capacity) {}
+
+    void push(T value)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _notFull.wait(lock, [&]() { return _items.size() < _capacity; });
+        _items.push_back(std::move(value));
+        _notEmpty.notify_one();
+    }
+
+    std::optional<T> pop()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _notEmpty.wait(lock, [&]() { return !_items.empty() || _closed; });
+        if (_items.empty()) { return std::nullopt; }
+        T value = std::move(_items.front());
+        _items.pop_front();
+        _notFull.notify_one();
+        return value;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _closed = true;
+        _notEmpty.notify_all();
+    }
+
+    // Everything pushed until the channel is closed, as the input of the next stage
+    Generator<T> drain()
+    {
+        while (std::optional<T> value = pop())
+        {
+            co_yield std::move(*value);
+        }
+    }
+
+private:
+    size_t _capacity;
+    std::deque<T> _items;
+    bool _closed = false;
+    std::mutex _mutex;
+    std::condition_variable _notFull, _notEmpty;
+};
+
+// Run a chain of stages on its own thread, pushing what it yields into a channel and closing the channel when it is done
+template<typename T>
+std::thread runStage(Generator<T> stage, Channel<T> &output)
+{
+    return std::thread([stage = std::move(stage), &output]() mutable
+    {
+        for (T &item : stage)
+        {
+            output.push(std::move(item));
+        }
+        output.close();
+    });
+}
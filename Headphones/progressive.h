@@ -0,0 +1,136 @@
+// Progressive rendering for interactive use: a first, coarse image within a fixed latency budget whatever the size of the mesh, then
+// finer ones until the deadline or until every triangle is drawn.
+//
+// Triangles are drawn largest first (by area, in the order a RefinementOrder stores), so the first pass already shows the overall shape
+// and later passes fill in detail. Each pass draws twice as many triangles as the one before it, cut short to what the measured rate
+// says fits before the deadline. After every pass the whole image so far is handed to a callback, with how much of the mesh it covers.
+#pragma once
+
+#include "renderer.h"
+#include "radixsort.h"
+#include <chrono>
+#include <functional>
+
+// Triangles of a mesh from largest to smallest. Camera independent, so it is built once per mesh, ahead of any time budget.
+struct RefinementOrder
+{
+    std::vector<uint32_t> triangles;
+    double totalArea = 0;
+};
+
+// What a pass of renderObjectProgressive has drawn so far
+struct ProgressivePass
+{
+    int pass;
+    size_t trianglesDrawn;
+    float coverage;         // Fraction of the mesh's total surface area drawn
+    double elapsedMs;       // Since the render started
+};
+
+inline float triangleArea(const Vec3f &a, const Vec3f &b, const Vec3f &c)
+{
+    return 0.5f * (b - a).crossProduct(c - a).length();
+}
+
+inline RefinementOrder buildRefinementOrder(const Mesh &mesh, unsigned threadCount = JobSystem::instance().getThreadCount())
+{
+    PROFILE_SCOPE("refinement_order");
+    size_t triangleCount = mesh.triangles.size() / 3;
+    RefinementOrder order;
+    order.triangles.resize(triangleCount);
+    std::vector<uint32_t> keys(triangleCount);
+    std::vector<double> areas(threadCount, 0);
+    forEachSlice(triangleCount, threadCount, [&](size_t begin, size_t end, unsigned t)
+    {
+        for (size_t i{begin}; i < end; ++i)
+        {
+            float area = triangleArea(mesh.vertices[mesh.triangles[i * 3]], mesh.vertices[mesh.triangles[i * 3 + 1]], mesh.vertices[mesh.triangles[i * 3 + 2]]);
+            keys[i] = floatSortKey(-area);  // Ascending keys, so descending areas
+            order.triangles[i] = (uint32_t)i;
+            areas[t] += area;
+        }
+    });
+    radixSort(keys, order.triangles, threadCount);
+    for (double area : areas)
+    {
+        order.totalArea += area;
+    }
+    return order;
+}
+
+// [comment]
+// Render mesh through context's camera in passes, coarse to fine, calling onPass with the complete svg document after each one.
+// onPass can return false to stop refining (e.g. the camera moved). Refinement also stops at the first pass to end after budget.
+// Returns the number of triangles drawn. Filled mode needs every triangle for its depth sort, so it is always one pass.
+// [/comment]
+inline size_t renderObjectProgressive
+(
+    const Mesh &mesh,                   // Object to draw
+    RenderContext &context,             // Camera settings. context.svg holds the document.
+    const RefinementOrder &order,       // Built from this mesh
+    std::chrono::steady_clock::duration budget,
+    const std::function<bool(const std::pmr::string &, const ProgressivePass &)> &onPass
+)
+{
+    // Small enough to be well under any interactive budget, even on a slow machine. Refining by fewer triangles than MIN_PASS isn't
+    // worth another callback.
+    constexpr size_t FIRST_PASS = 4096, MIN_PASS = 1024;
+
+    auto start = std::chrono::steady_clock::now(), deadline = start + budget;
+    auto elapsedMs = [&]() { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(); };
+    Matrix44f worldToCamera = context.cameraToWorld.inverse();
+    size_t triangleCount = order.triangles.size();
+
+    if (context.mode == RenderMode::Filled)
+    {
+        projectObject(mesh, context, worldToCamera, context.svg);
+        onPass(context.svg, {0, triangleCount, 1, elapsedMs()});
+        return triangleCount;
+    }
+
+    context.svg.clear();
+    SvgSink sink(context.svg);
+    sink.begin(context.imageWidth, context.imageHeight);
+
+    size_t drawn = 0, passSize = FIRST_PASS;
+    double areaDrawn = 0, drawingMs = 0;
+    for (int pass{0}; drawn < triangleCount; ++pass)
+    {
+        // Grow the document up front, so the pass isn't slowed down by copying it
+        size_t count = std::min(passSize, triangleCount - drawn);
+        if (drawn > 0) { context.svg.reserve(context.svg.size() + count * (context.svg.size() / drawn + 1)); }
+
+        // Cut the pass down to what the rate so far says fits in most of the time left
+        double remainingMs = std::chrono::duration<double, std::milli>(deadline - std::chrono::steady_clock::now()).count();
+        if (pass > 0 && drawingMs > 0)
+        {
+            size_t fits = (size_t)std::max(0.0, 0.9 * remainingMs * drawn / drawingMs);
+            if (fits < std::min(count, MIN_PASS)) { break; }
+            count = std::min(count, fits);
+        }
+
+        PROFILE_SCOPE("progressive_pass");
+        auto passStart = std::chrono::steady_clock::now();
+        projectTriangles(mesh, context, worldToCamera, drawn, count, sink, order.triangles.data());
+        for (size_t k{drawn}; k < drawn + count; ++k)
+        {
+            const int *corners = &mesh.triangles[order.triangles[k] * 3];
+            areaDrawn += triangleArea(mesh.vertices[corners[0]], mesh.vertices[corners[1]], mesh.vertices[corners[2]]);
+        }
+        drawn += count;
+        drawingMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - passStart).count();
+
+        // Close the document for the callback, then reopen it for the next pass
+        size_t open = context.svg.size();
+        sink.end();
+        float coverage = drawn == triangleCount ? 1 : order.totalArea > 0 ? (float)(areaDrawn / order.totalArea) : (float)drawn / triangleCount;
+        bool more = onPass(context.svg, {pass, drawn, coverage, elapsedMs()});
+        if (!more || std::chrono::steady_clock::now() >= deadline || drawn == triangleCount) { return drawn; }
+        context.svg.resize(open);
+        passSize *= 2;
+    }
+
+    // Stopped before a pass that wouldn't fit: the document has to be closed again
+    sink.end();
+    return drawn;
+}
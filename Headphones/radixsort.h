@@ -0,0 +1,92 @@
+// Parallel LSD radix sort of 32 bit keys carrying 32 bit values, for ordering millions of triangles by depth.
+// Keys are sorted 11 bits at a time, so three passes. In each pass every thread counts the digits of its slice of the input, the counts
+// are turned into where each (digit, thread) run starts in the output, and every thread then scatters its slice there. Threads write
+// disjoint parts of the output and the sort is stable, so the result is the same whatever the thread count.
+#pragma once
+
+#include "profiler.h"
+#include "jobsystem.h"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+// Key whose unsigned order is the order of the floats: positives get their sign bit set, negatives have every bit flipped
+inline uint32_t floatSortKey(float f)
+{
+    uint32_t bits = std::bit_cast<uint32_t>(f);
+    return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+}
+
+// [comment]
+// Run body(begin, end, slice) over sliceCount slices of [0, count), as jobs on the shared pool (see jobsystem.h), the last on the
+// calling thread. However many renders slice their work at once, no more threads run than the pool has.
+// [/comment]
+template <typename Body>
+inline void forEachSlice(size_t count, unsigned sliceCount, const Body &body)
+{
+    JobSystem &jobs = JobSystem::instance();
+    JobCounter counter{0};
+    for (unsigned t{0}; t + 1 < sliceCount; ++t)
+    {
+        size_t begin = count * t / sliceCount, end = count * (t + 1) / sliceCount;
+        jobs.run([&body, begin, end, t]() { body(begin, end, t); }, counter);
+    }
+    body(count * (sliceCount - 1) / sliceCount, count, sliceCount - 1);
+    jobs.wait(counter);
+}
+
+// Sort keys ascending, moving values along with them. Below about 64k keys per thread extra threads cost more than they save.
+inline void radixSort(std::vector<uint32_t> &keys, std::vector<uint32_t> &values, unsigned threadCount = JobSystem::instance().getThreadCount())
+{
+    PROFILE_SCOPE("radix_sort");
+    constexpr int DIGIT_BITS = 11;
+    constexpr size_t DIGITS = size_t(1) << DIGIT_BITS;
+    size_t count = keys.size();
+    threadCount = (unsigned)std::clamp<size_t>(count / 65536, 1, threadCount);
+
+    std::vector<uint32_t> keysOut(count), valuesOut(count);
+    std::vector<size_t> offsets(threadCount * DIGITS);
+    for (int shift{0}; shift < 32; shift += DIGIT_BITS)
+    {
+        forEachSlice(count, threadCount, [&](size_t begin, size_t end, unsigned t)
+        {
+            size_t *counts = &offsets[t * DIGITS];
+            std::fill(counts, counts + DIGITS, 0);
+            for (size_t i{begin}; i < end; ++i)
+            {
+                counts[(keys[i] >> shift) & (DIGITS - 1)]++;
+            }
+        });
+
+        // Digit by digit, then thread by thread within a digit, which keeps equal digits in input order
+        size_t position = 0;
+        bool oneDigit = false;
+        for (size_t digit{0}; digit < DIGITS; ++digit)
+        {
+            size_t digitStart = position;
+            for (unsigned t{0}; t < threadCount; ++t)
+            {
+                size_t digitCount = offsets[t * DIGITS + digit];
+                offsets[t * DIGITS + digit] = position;
+                position += digitCount;
+            }
+            if (position - digitStart == count) { oneDigit = true; }
+        }
+        // Every key has the same digit (common for the high bits of depths in a small range), so the pass would change nothing
+        if (oneDigit) { continue; }
+
+        forEachSlice(count, threadCount, [&](size_t begin, size_t end, unsigned t)
+        {
+            size_t *next = &offsets[t * DIGITS];
+            for (size_t i{begin}; i < end; ++i)
+            {
+                size_t position = next[(keys[i] >> shift) & (DIGITS - 1)]++;
+                keysOut[position] = keys[i];
+                valuesOut[position] = values[i];
+            }
+        });
+        keys.swap(keysOut);
+        values.swap(valuesOut);
+    }
+}
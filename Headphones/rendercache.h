@@ -0,0 +1,213 @@
+// Cache of finished renders, addressed by their content: the key is a hash of everything that decides the output (the mesh's vertices
+// and triangles, the camera matrix and intrinsics, the image size the render mode and the output format), so asking for the same render twice finds it
+// whatever the request looked like. Two tiers, each with a size limit and evicting the least recently used renders first:
+// memory, then optionally a directory on disk that outlives the process.
+#pragma once
+
+#include "renderer.h"
+#include <cinttypes>
+#include <filesystem>
+#include <list>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+
+// Key of a render of mesh through context's camera, in the given output format
+inline uint64_t renderKey(const Mesh &mesh, const RenderContext &context, std::string_view format = "svg")
+{
+    uint64_t key = hashBytes(&mesh.contentHash, sizeof(mesh.contentHash));
+    float intrinsics[] = {context.focalLength, context.filmApertureWidth, context.filmApertureHeight, context.nearClippingPlane, context.farClippingPlane};
+    uint32_t size[] = {context.imageWidth, context.imageHeight, (uint32_t)context.mode};
+    key = hashBytes(&context.cameraToWorld[0][0], sizeof(float) * 16, key);
+    key = hashBytes(intrinsics, sizeof(intrinsics), key);
+    key = hashBytes(size, sizeof(size), key);
+    return hashBytes(format.data(), format.size(), key);
+}
+
+class RenderCache
+{
+public:
+    struct Stats
+    {
+        uint64_t memoryHits = 0, diskHits = 0, misses = 0, evictions = 0;
+    };
+
+    // An empty directory means memory only
+    RenderCache(size_t memoryLimit = 256 << 20, std::string directory = "", size_t diskLimit = size_t(1) << 30)
+        : _memoryLimit(memoryLimit), _directory(directory), _diskLimit(diskLimit)
+    {
+        if (_directory.empty()) { return; }
+        // Renders left by earlier runs count towards the limit, oldest first
+        std::filesystem::create_directories(_directory);
+        std::vector<std::pair<std::filesystem::file_time_type, std::pair<uint64_t, size_t>>> files;
+        for (const auto &entry : std::filesystem::directory_iterator(_directory))
+        {
+            uint64_t key;
+            if (entry.is_regular_file() && std::sscanf(entry.path().filename().c_str(), "%16" SCNx64 ".render", &key) == 1)
+            {
+                files.push_back({entry.last_write_time(), {key, (size_t)entry.file_size()}});
+            }
+        }
+        std::sort(files.begin(), files.end());
+        for (const auto &file : files)
+        {
+            _disk.push_front({file.second.first, file.second.second, _generation++});
+            _diskIndex[file.second.first] = _disk.begin();
+            _diskBytes += file.second.second;
+        }
+    }
+
+    // Look a render up in memory, then on disk (which brings it back into memory). Returns whether it was found.
+    bool get(uint64_t key, std::string &output)
+    {
+        uint64_t generation;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto found = _memoryIndex.find(key);
+            if (found != _memoryIndex.end())
+            {
+                _memory.splice(_memory.begin(), _memory, found->second);
+                output = found->second->second;
+                _stats.memoryHits++;
+                return true;
+            }
+            auto onDisk = _diskIndex.find(key);
+            if (onDisk == _diskIndex.end())
+            {
+                _stats.misses++;
+                return false;
+            }
+            _disk.splice(_disk.begin(), _disk, onDisk->second);
+            generation = onDisk->second->generation;
+        }
+
+        // Read outside the lock so other lookups don't wait on the disk
+        std::ifstream file(path(key), std::ios::binary);
+        std::ostringstream contents;
+        contents << file.rdbuf();
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!file)
+        {
+            // The file has gone or can't be read: forget it, unless it was written again meanwhile
+            auto onDisk = _diskIndex.find(key);
+            if (onDisk != _diskIndex.end() && onDisk->second->generation == generation)
+            {
+                _diskBytes -= onDisk->second->size;
+                _disk.erase(onDisk->second);
+                _diskIndex.erase(onDisk);
+            }
+            _stats.misses++;
+            return false;
+        }
+        output = contents.str();
+        _stats.diskHits++;
+        insertInMemory(key, output);
+        return true;
+    }
+
+    // [comment]
+    // The file is written under a temporary name and renamed, so a reader never sees half a file, and only indexed once it is in place,
+    // so get never finds an entry whose file is still being written. Evicted files are deleted with the lock held: a put of the same key
+    // can't have indexed its new file in between, since it indexes under the lock too.
+    // [/comment]
+    void put(uint64_t key, std::string_view output)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            insertInMemory(key, std::string(output));
+            if (_directory.empty() || _diskIndex.count(key)) { return; }
+        }
+
+        std::string finalPath = path(key), temporaryPath = finalPath + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        std::ofstream(temporaryPath, std::ios::binary).write(output.data(), output.size());
+        std::error_code error;
+        std::filesystem::rename(temporaryPath, finalPath, error);
+        if (error) { return; }
+
+        // Another put of the same key may have got here first, with the same output since the key covers everything that decides it
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_diskIndex.count(key)) { return; }
+        _disk.push_front({key, output.size(), _generation++});
+        _diskIndex[key] = _disk.begin();
+        _diskBytes += output.size();
+        while (_diskBytes > _diskLimit && _disk.size() > 1)
+        {
+            std::filesystem::remove(path(_disk.back().key), error);
+            _diskBytes -= _disk.back().size;
+            _diskIndex.erase(_disk.back().key);
+            _disk.pop_back();
+            _stats.evictions++;
+        }
+    }
+
+    Stats getStats()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _stats;
+    }
+
+private:
+    std::string path(uint64_t key) const
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016" PRIx64 ".render", key);
+        return (std::filesystem::path(_directory) / name).string();
+    }
+
+    // Called with the lock held
+    void insertInMemory(uint64_t key, std::string output)
+    {
+        if (output.size() > _memoryLimit || _memoryIndex.count(key)) { return; }
+        _memoryBytes += output.size();
+        _memory.emplace_front(key, std::move(output));
+        _memoryIndex[key] = _memory.begin();
+        while (_memoryBytes > _memoryLimit)
+        {
+            _memoryBytes -= _memory.back().second.size();
+            _memoryIndex.erase(_memory.back().first);
+            _memory.pop_back();
+            _stats.evictions++;
+        }
+    }
+
+    std::mutex _mutex;
+    Stats _stats;
+
+    // Most recently used first
+    size_t _memoryLimit, _memoryBytes = 0;
+    std::list<std::pair<uint64_t, std::string>> _memory;
+    std::unordered_map<uint64_t, std::list<std::pair<uint64_t, std::string>>::iterator> _memoryIndex;
+
+    std::string _directory;
+    size_t _diskLimit, _diskBytes = 0;
+    struct DiskEntry
+    {
+        uint64_t key;
+        size_t size;
+        uint64_t generation;    // Tells an entry from one indexed for the same key after it was dropped
+    };
+    std::list<DiskEntry> _disk;     // Every file
+    std::unordered_map<uint64_t, std::list<DiskEntry>::iterator> _diskIndex;
+    uint64_t _generation = 0;
+};
+
+// [comment]
+// renderObject with a cache in front of it: a render already in the cache is copied to context.filename without drawing anything.
+// Returns whether it came from the cache.
+// [/comment]
+inline bool renderObjectCached(const Mesh &mesh, RenderContext &context, RenderCache &cache)
+{
+    uint64_t key = renderKey(mesh, context);
+    std::string output;
+    bool hit = cache.get(key, output);
+    // Two call sites, as each PROFILE_COUNT looks its counter up once by the name it is first called with
+    if (hit) { PROFILE_COUNT("render_cache_hits", 1); } else { PROFILE_COUNT("render_cache_misses", 1); }
+    if (!hit)
+    {
+        projectObject(mesh, context, context.cameraToWorld.inverse(), context.svg);
+        output.assign(context.svg.data(), context.svg.size());
+        cache.put(key, output);
+    }
+    std::ofstream(context.filename, std::ios::binary).write(output.data(), output.size());
+    return hit;
+}
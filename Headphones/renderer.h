@@ -0,0 +1,887 @@
+// Renders objects made from Blender vertex dumps (see Mesh::load) as svg wireframes.
+// All state lives in a Mesh, which owns the geometry, and a RenderContext, which owns the camera, output settings and scratch memory
+// of one render. Nothing is global, so independent renders can run on different threads at the same time, and one Mesh can be
+// shared by any number of renders since drawing only reads it.
+#pragma once
+
+#include "geometry.h"
+#include "profiler.h"
+#include "vertexcache.h"
+#include "pipeline.h"
+#include "radixsort.h"
+#include "sinks.h"
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <thread>
+#include <semaphore>
+#include <memory_resource>
+#include <charconv>
+#include <cstring>
+#include <atomic>
+#include <numbers>
+
+// Two vectors, one to store all vertex coordinates, and the other to store which indices of vertices in the vertices vector are linked together to make a triangle.
+// Both are allocated from the mesh's own monotonic arena, which is released in one go when another file is loaded.
+struct Mesh
+{
+    bool load(std::string filename);
+
+    std::pmr::monotonic_buffer_resource arena;
+    std::pmr::vector<Vec3f> vertices{&arena};
+    std::pmr::vector<int> triangles{&arena};
+
+    // Vertex cache miss ratio of the triangles in file order, and after load reordered them (see vertexcache.h)
+    float fileACMR = 0, optimizedACMR = 0;
+
+    // Hash of the vertices and triangles as load left them, which identifies the mesh in a RenderCache (see rendercache.h)
+    uint64_t contentHash = 0;
+};
+
+// Wireframe draws every edge as a line. Filled draws every triangle in front of the camera as a flat shaded polygon, far ones first,
+// so nearer ones paint over them (see projectFilled).
+enum class RenderMode { Wireframe, Filled };
+
+// Everything one render needs besides the mesh. Settings can be taken from Blender Camera to replicate.
+struct RenderContext
+{
+    RenderContext(float fLength, float fAW, float fAH, float nCP, float fCP, Matrix44f cameraToWorld, std::string filename)
+        : focalLength(fLength), filmApertureWidth(fAW), filmApertureHeight(fAH), nearClippingPlane(nCP), farClippingPlane(fCP),
+          cameraToWorld(cameraToWorld), filename(filename) {}
+
+    float focalLength;          // Focal Length, mm
+    float filmApertureWidth;    // Film Aperture Width, mm
+    float filmApertureHeight;   // Film Aperture Height, mm
+    float nearClippingPlane;    // Near Clipping Plane, m
+    float farClippingPlane;     // Far Clipping Plane, m
+    Matrix44f cameraToWorld;    // Camera to World matrix, i.e. how has the camera been transformed
+
+    uint32_t imageWidth = 512, imageHeight = 512;   // Final Image Dimensions
+    std::string filename;                           // Output file name
+    RenderMode mode = RenderMode::Wireframe;
+
+    Matrix44f getProjection() const;
+
+    // Output text is drawn from this pool, which keeps the blocks handed back to it so later frames reuse them instead of going to the heap
+    std::pmr::unsynchronized_pool_resource pool;
+    std::pmr::string svg{&pool};
+};
+
+// A camera pose on an animation path. Rotations and translation are the same parameters getCameraToWorld takes.
+struct CameraKeyframe
+{
+    float frame;
+    float s1, s2, s3;
+    float x, y, z;
+};
+
+// Triangles [first, first + count) of a mesh on their way through the stages of renderObject
+struct TriangleBatch
+{
+    size_t first = 0, count = 0;
+};
+
+bool computeCoordinates(const Vec3f &pWorld, const Matrix44f &worldToRaster, float imageWidth, float imageHeight, Vec2i &pRaster);
+
+void renderObject(const Mesh &mesh, RenderContext &context);
+Generator<TriangleBatch> triangleSource(const Mesh &mesh, size_t batchSize);
+Generator<std::pmr::string> projectStage(Generator<TriangleBatch> batches, const Mesh &mesh, const RenderContext &context, Matrix44f worldToCamera);
+void projectObject(const Mesh &mesh, const RenderContext &context, const Matrix44f &worldToCamera, std::pmr::string &svg);
+void projectTriangles(const Mesh &mesh, const RenderContext &context, const Matrix44f &worldToCamera, size_t first, size_t count, std::pmr::string &svg);
+template <OutputSink Sink> void projectTriangles(const Mesh &mesh, const RenderContext &context, const Matrix44f &worldToCamera, size_t first, size_t count, Sink &sink, const uint32_t *order = nullptr);
+void projectFilled(const Mesh &mesh, const RenderContext &context, const Matrix44f &worldToCamera, std::pmr::string &svg);
+void renderAnimation(const Mesh &mesh, RenderContext &context, const std::vector<CameraKeyframe> &keyframes, int frameCount);
+bool renderObjectStreamed(const RenderContext &context, std::string inputFilename, size_t chunkSize = 1 << 20);
+
+Matrix44f getCameraToWorld(float s1, float s2, float s3, float x, float y, float z);
+Matrix44f rigidInverse(const Matrix44f &m);
+
+// 64 bit FNV-1a of size bytes, continuing from hash
+inline uint64_t hashBytes(const void *data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i{0}; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+#ifdef COUNT_ALLOCATIONS
+// Defined by the program, which replaces the global operator new to count every allocation made through the general purpose heap
+extern std::atomic<size_t> allocationCount;
+#endif
+
+// Float casts for trig functions
+inline float cosf(float angle) { return (float)(cos(angle * std::numbers::pi/180)); }
+inline float sinf(float angle) { return (float)(sin(angle * std::numbers::pi/180)); }
+
+// [comment]
+// Reads from a text file generated from Blender that contains all the vertices of a 3D object and how they are connected to each other. 
+// Stores the vertices in the mesh's vertices vector, and which points are connected to each other in its triangles vector
+
+// Text file should have the form:
+// vertex Flag:
+// x1 x2 x3
+// x1 x2 x3
+// ...
+// x1 x2 x3
+// connection Flag:
+// a b c ...
+
+// [/comment]
+
+inline bool Mesh::load(std::string filename)
+{
+    PROFILE_SCOPE("parse");
+    std::ifstream inputFile(filename);
+
+    if (inputFile.is_open())
+    {   
+        // Drop the previous mesh and hand all of its memory back at once
+        vertices.clear();
+        vertices.shrink_to_fit();
+        triangles.clear();
+        triangles.shrink_to_fit();
+        arena.release();
+
+        std::string line;
+        bool readingVertices = false;
+        bool readingTris = false;
+        size_t objectStart = 0;     // Index of the current object's first vertex
+
+        while (std::getline(inputFile, line))
+        {
+            if (line == "Array of vertices:")
+            {
+                readingVertices = true;
+                objectStart = vertices.size();
+            } else if (line == "Array of connected vertices:")
+            {
+                readingVertices = false;
+                readingTris = true;
+            } 
+            else if (readingVertices)
+            {
+                // Read every line up to the connection flag, each containing 3 floats. Parsed in place, a stream per line would allocate every time.
+                char *end;
+                float x = std::strtof(line.c_str(), &end);
+                float y = std::strtof(end, &end);
+                float z = std::strtof(end, &end);
+                if (end == line.c_str()) { continue; }
+                Vec3f vertex = {x,y,z};
+                vertices.push_back(vertex);
+            } else if (readingTris)
+            {
+                // Read next line
+                const char *p = line.c_str();
+                char *end;
+                size_t firstIndex = triangles.size();
+                for (long index = std::strtol(p, &end, 10); end != p; index = std::strtol(p, &end, 10))
+                {
+                    p = end;
+                    // indices in text file are relative to the object's vertices, not the entire list.
+                    index += objectStart;
+                    triangles.push_back(index >= (long)objectStart && index < (long)vertices.size() ? (int)index : -1);
+                }
+                readingTris = false;
+
+                // A bad or truncated file can name vertices the object doesn't have, or end partway through a triangle.
+                // Those triangles are dropped, so nothing after this indexes past the end of the vertices.
+                size_t kept = firstIndex;
+                for (size_t i{firstIndex}; i + 3 <= triangles.size(); i += 3)
+                {
+                    if (triangles[i] < 0 || triangles[i + 1] < 0 || triangles[i + 2] < 0) { continue; }
+                    for (int c{0}; c < 3; ++c) { triangles[kept++] = triangles[i + c]; }
+                }
+                if (kept < triangles.size())
+                {
+                    std::cerr << "Dropped " << (triangles.size() - kept + 2) / 3 << " incomplete triangles or triangles with vertex indices out of range" << std::endl;
+                    triangles.resize(kept);
+                }
+            } else 
+            {
+                continue;
+            }
+        }
+
+        fileACMR = computeACMR(triangles);
+        optimizeVertexCache(vertices, triangles);
+        optimizedACMR = computeACMR(triangles);
+        contentHash = hashBytes(vertices.data(), vertices.size() * sizeof(Vec3f));
+        contentHash = hashBytes(triangles.data(), triangles.size() * sizeof(int), contentHash);
+        return 1;
+    } else {
+        std::cerr << "Could not open file";
+        return 0;
+    }
+}
+
+// [comment]
+// Get a cameraToWorld matrix, which is defined to be how the camera's transformation can be described relative to global coordinates.
+// Used to calculate coordinates in the screen space before converting to raster space.
+// First 3 parameters are rotations around x, y, and z axes respectively, and the next three describe the translation of the camera.
+// Parameters should be taken from Blender Camera settings to replicate
+// [/comment]
+inline Matrix44f getCameraToWorld(float s1, float s2, float s3, float x, float y, float z)
+{
+    PROFILE_SCOPE("camera_setup");
+    // Rotation around X
+    Matrix44f rotx = 
+    {
+        1, 0, 0, 0,
+        0, cosf(s1), sinf(s1), 0,
+        0, -sinf(s1), cosf(s1), 0,
+        0, 0, 0, 1
+    };
+
+    // Rotation around Y (Negative because x-axis points in opposite direction than convenetional when looking down the y-axis)
+    Matrix44f roty = 
+    {
+        cosf(-s2), 0, sinf(-s2), 0,
+        0, 1, 0, 0,
+        -sinf(-s2), 0, cosf(-s2), 0,
+        0, 0, 0, 1
+    };
+
+    // Rotation around Z
+    Matrix44f rotz = 
+    {
+       cosf(s3), sinf(s3), 0, 0,
+       -sinf(s3), cosf(s3), 0, 0, 
+       0, 0, 1, 0,
+       0, 0, 0, 1 
+    };
+
+    // Translation to (x,y,z)
+    Matrix44f translation = 
+    {
+        1, 0, 0, 0,
+        0, 1, 0, 0,
+        0, 0, 1, 0,
+        x, y, z, 1
+    };
+
+    // Compose 3 Rotations and a translation together
+    Matrix44f temp;
+    Matrix44f::multiply(rotx, roty, temp);
+
+    Matrix44f temp2;
+    Matrix44f::multiply(temp, rotz, temp2);
+
+    Matrix44f cameraToWorld;
+    Matrix44f::multiply(temp2, translation, cameraToWorld);
+
+    return cameraToWorld;
+}
+
+// [comment]
+// Perspective projection and viewport of the camera in one matrix, taking camera space straight to homogeneous raster space.
+// It folds together the steps of the scratchapixel pinhole camera (https://github.com/scratchapixel/scratchapixel-code/blob/main/3d-viewing-pinhole-camera/pinhole.cpp):
+//     screen = camera.xy / -camera.z * near
+//     NDC    = (screen + (right, top)) / (2 * (right, top))      where right = (filmApertureWidth / 2) / focalLength * near, same for top
+//     raster = (NDC.x * imageWidth, (1 - NDC.y) * imageHeight)
+// Near cancels out, leaving raster.x = imageWidth * focalLength / filmApertureWidth * x / -z + imageWidth / 2, and likewise for y.
+// w is -z, so after the divide by w the x and y columns give raster coordinates. z is mapped to [-1, 1] between the clipping planes
+// (scratchapixel's OpenGL convention), which the wireframe doesn't use but keeps the depth around for anything that does.
+// [/comment]
+inline Matrix44f RenderContext::getProjection() const
+{
+    float w = (float)imageWidth, h = (float)imageHeight;
+    float n = nearClippingPlane, f = farClippingPlane;
+    return Matrix44f
+    (
+        w * focalLength / filmApertureWidth, 0, 0, 0,
+        0, -h * focalLength / filmApertureHeight, 0, 0,
+        -w / 2, -h / 2, -(f + n) / (f - n), -1,
+        0, 0, -2 * f * n / (f - n), 0
+    );
+}
+
+// [comment]
+// Used to compute the raster coordinates of a point in the world, returning whether that point is visible or not. 
+// However, it will also assign a Vec2<int> value to the corresponding world coordinate, which can then be drawn.
+// worldToRaster is worldToCamera concatenated with getProjection(), so a point costs one matrix multiply and one reciprocal.
+// [/comment]
+inline bool computeCoordinates
+(
+    const Vec3f &pWorld,            // Point in the world to transform to raster space
+    const Matrix44f &worldToRaster, // worldToCamera * projection
+    float imageWidth,               // Dimensions of final image.
+    float imageHeight,
+    Vec2i &pRaster                  // Point in raster space to affect
+)
+{
+    const Matrix44f &m = worldToRaster;
+    float x = pWorld.x * m[0][0] + pWorld.y * m[1][0] + pWorld.z * m[2][0] + m[3][0];
+    float y = pWorld.x * m[0][1] + pWorld.y * m[1][1] + pWorld.z * m[2][1] + m[3][1];
+    float w = pWorld.x * m[0][3] + pWorld.y * m[1][3] + pWorld.z * m[2][3] + m[3][3];
+
+    float invW = 1 / w;
+    x *= invW;
+    y *= invW;
+    pRaster.x = (int)x;
+    pRaster.y = (int)y;
+
+    // Check if point lies in the screen
+    return x >= 0 && x <= imageWidth && y >= 0 && y <= imageHeight;
+}
+
+// [comment]
+// Code has been adapted from https://github.com/scratchapixel/scratchapixel-code/blob/main/3d-viewing-pinhole-camera/pinhole.cpp
+// Allows user to easily create a render of the object from camera settings they specify. 
+//
+// The render is a pipeline of stages (see pipeline.h) over batches of triangles:
+//     triangleSource -> projectStage  |  file output
+// with a bounded channel at the |, so projecting a batch into svg text overlaps with writing the ones before it to disk.
+// A new stage slots in between two others without touching them.
+// [/comment]
+inline void renderObject
+(
+    const Mesh &mesh,           // Object to draw
+    RenderContext &context      // Camera and output settings
+)
+{
+    Matrix44f worldToCamera;
+    {
+        PROFILE_SCOPE("camera_inverse");
+        worldToCamera = context.cameraToWorld.inverse();
+    }
+
+    // Filled polygons can't be streamed: nothing can be written before every triangle has been sorted by depth
+    if (context.mode == RenderMode::Filled)
+    {
+        projectObject(mesh, context, worldToCamera, context.svg);
+        PROFILE_SCOPE("file_output");
+        std::ofstream(context.filename).write(context.svg.data(), context.svg.size());
+        PROFILE_COUNT("bytes_written", context.svg.size());
+        return;
+    }
+
+    // Few batches in flight at a time, enough to keep both stages busy
+    constexpr size_t BATCH_SIZE = 256, CHANNEL_CAPACITY = 4;
+    Channel<std::pmr::string> projected(CHANNEL_CAPACITY);
+    std::thread projection = runStage(projectStage(triangleSource(mesh, BATCH_SIZE), mesh, context, worldToCamera), projected);
+
+    // The batches are fragments, the document's header and footer are written around them
+    std::ofstream ofs;
+    ofs.open(context.filename);
+    context.svg.clear();
+    SvgSink document(context.svg);
+    document.begin(context.imageWidth, context.imageHeight);
+    document.write(ofs);
+    for (std::pmr::string &text : projected.drain())
+    {
+        PROFILE_SCOPE("file_output");
+        ofs.write(text.data(), text.size());
+    }
+    context.svg.clear();
+    document.end();
+    document.write(ofs);
+    PROFILE_COUNT("bytes_written", (size_t)ofs.tellp());
+    ofs.close();
+
+    projection.join();
+}
+
+// Splits a mesh's triangles into batches, in order
+inline Generator<TriangleBatch> triangleSource(const Mesh &mesh, size_t batchSize)
+{
+    size_t triangleCount = mesh.triangles.size() / 3;
+    for (size_t first{0}; first < triangleCount; first += batchSize)
+    {
+        TriangleBatch batch;
+        batch.first = first;
+        batch.count = std::min(batchSize, triangleCount - first);
+        co_yield std::move(batch);
+    }
+}
+
+// Svg lines of every triangle in a batch, as a fragment without the document's header and footer
+inline Generator<std::pmr::string> projectStage(Generator<TriangleBatch> batches, const Mesh &mesh, const RenderContext &context, Matrix44f worldToCamera)
+{
+    for (TriangleBatch &batch : batches)
+    {
+        std::pmr::string svg;
+        SvgSink sink(svg);
+        projectTriangles(mesh, context, worldToCamera, batch.first, batch.count, sink);
+        co_yield std::move(svg);
+    }
+}
+
+// [comment]
+// Projects every triangle of the object and writes the whole svg document into a string, so the projection can run separately from file output.
+// The string keeps its capacity between calls, so once it has grown to the size of a frame no more memory is allocated.
+// [/comment]
+inline void projectObject
+(
+    const Mesh &mesh,               // Object to draw
+    const RenderContext &context,   // Camera settings
+    const Matrix44f &worldToCamera, // Inverse of the camera's transformation
+    std::pmr::string &svg           // Output, overwritten
+)
+{
+    svg.clear();
+    SvgSink sink(svg);
+    sink.begin(context.imageWidth, context.imageHeight);
+    if (context.mode == RenderMode::Filled)
+    {
+        projectFilled(mesh, context, worldToCamera, svg);
+    } else
+    {
+        projectTriangles(mesh, context, worldToCamera, 0, mesh.triangles.size()/3, sink);
+    }
+    sink.end();
+}
+
+// [comment]
+// Projects count triangles of the object starting at triangle first, and hands each one to sink (see sinks.h).
+// Separate ranges can be projected on separate threads, into separate sinks, and joined in order afterwards.
+// This is the one projection loop: every wireframe render, whole, pipelined, streamed or progressive, goes through it.
+// [/comment]
+template <OutputSink Sink>
+inline void projectTriangles
+(
+    const Mesh &mesh,               // Object to draw
+    const RenderContext &context,   // Camera settings
+    const Matrix44f &worldToCamera, // Inverse of the camera's transformation
+    size_t first,                   // First triangle to draw
+    size_t count,                   // Number of triangles to draw
+    Sink &sink,                     // Output
+    const uint32_t *order           // If not null, draw triangles order[first], order[first + 1], ... instead
+)
+{
+    // Camera and projection in one transform
+    Matrix44f worldToRaster = worldToCamera * context.getProjection();
+    float imageWidth = (float)context.imageWidth, imageHeight = (float)context.imageHeight;
+
+    // Triangles go through projection and then output in batches, so the two stages can be timed separately without a timer per vertex
+    constexpr size_t BATCH_SIZE = 256;
+    Vec2i rasters[BATCH_SIZE * 3];
+    bool visibility[BATCH_SIZE];
+    size_t end = first + count;
+    for (size_t start{first}; start < end; start += BATCH_SIZE)
+    {
+        size_t batchSize = std::min(BATCH_SIZE, end - start);
+        {
+            PROFILE_SCOPE("projection");
+            for (size_t b{0}; b < batchSize; ++b)
+            {
+                // Grab 3 vertices that make up a triangle
+                size_t i = order ? order[start + b] : start + b;
+                const Vec3f &v0World = mesh.vertices[mesh.triangles[i * 3]];
+                const Vec3f &v1World = mesh.vertices[mesh.triangles[i * 3 + 1]];
+                const Vec3f &v2World = mesh.vertices[mesh.triangles[i * 3 + 2]];
+
+                bool visible = true;
+
+                // Visible only if all vertices making up that triangle are in the canvas frame, and assign raster coordinates 
+                visible &= computeCoordinates(v0World, worldToRaster, imageWidth, imageHeight, rasters[b * 3]);
+                visible &= computeCoordinates(v1World, worldToRaster, imageWidth, imageHeight, rasters[b * 3 + 1]);
+                visible &= computeCoordinates(v2World, worldToRaster, imageWidth, imageHeight, rasters[b * 3 + 2]);
+                visibility[b] = visible;
+                PROFILE_COUNT("triangles_culled", !visible);
+            }
+            PROFILE_COUNT("triangles_processed", batchSize);
+        }
+
+        PROFILE_SCOPE("svg_output");
+        for (size_t b{0}; b < batchSize; ++b)
+        {
+            sink.triangle(rasters[b * 3], rasters[b * 3 + 1], rasters[b * 3 + 2], visibility[b]);
+        }
+        PROFILE_COUNT("triangles_emitted", batchSize);
+    }
+}
+
+// Svg lines of count triangles starting at triangle first, appended to a string
+inline void projectTriangles(const Mesh &mesh, const RenderContext &context, const Matrix44f &worldToCamera, size_t first, size_t count, std::pmr::string &svg)
+{
+    SvgSink sink(svg);
+    projectTriangles(mesh, context, worldToCamera, first, count, sink);
+}
+
+// [comment]
+// Render the whole object into sink, e.g. a RasterSink for an image or a NullSink to time projection alone.
+// The wireframe only: RenderMode::Filled is an svg feature (see projectFilled).
+// [/comment]
+template <OutputSink Sink>
+inline void renderObject(const Mesh &mesh, const RenderContext &context, Sink &sink)
+{
+    Matrix44f worldToCamera = context.cameraToWorld.inverse();
+    sink.begin(context.imageWidth, context.imageHeight);
+    projectTriangles(mesh, context, worldToCamera, 0, mesh.triangles.size() / 3, sink);
+    sink.end();
+}
+
+// [comment]
+// Painter's algorithm: every triangle in front of the near plane and overlapping the image is given the sum of its vertices' camera space
+// depths as a key, the keys are radix sorted (see radixsort.h) and the triangles appended as svg polygons from the farthest to the nearest.
+// Each is shaded by how directly it faces the camera. Every step is split across the shared pool (see jobsystem.h), so at millions of
+// triangles the sort costs about as much as a projection pass rather than dominating like a comparison sort would.
+// [/comment]
+inline void projectFilled
+(
+    const Mesh &mesh,               // Object to draw
+    const RenderContext &context,   // Camera settings
+    const Matrix44f &worldToCamera, // Inverse of the camera's transformation
+    std::pmr::string &svg           // Output, appended to
+)
+{
+    unsigned threadCount = JobSystem::instance().getThreadCount();
+    Matrix44f projection = context.getProjection();
+    float imageWidth = (float)context.imageWidth, imageHeight = (float)context.imageHeight;
+    size_t triangleCount = mesh.triangles.size() / 3;
+
+    // Every vertex once, in camera space and in raster space
+    std::vector<Vec3f> cameraPoints(mesh.vertices.size());
+    std::vector<Vec2i> rasters(mesh.vertices.size());
+    forEachSlice(mesh.vertices.size(), threadCount, [&](size_t begin, size_t end, unsigned)
+    {
+        PROFILE_SCOPE("projection");
+        for (size_t v{begin}; v < end; ++v)
+        {
+            worldToCamera.multVecMatrix(mesh.vertices[v], cameraPoints[v]);
+            computeCoordinates(cameraPoints[v], projection, imageWidth, imageHeight, rasters[v]);
+        }
+    });
+
+    // Which triangles are drawn, counted per slice so each slice knows where its keys go
+    std::vector<uint8_t> drawn(triangleCount);
+    std::vector<size_t> sliceStarts(threadCount + 1, 0);
+    forEachSlice(triangleCount, threadCount, [&](size_t begin, size_t end, unsigned t)
+    {
+        size_t kept = 0;
+        for (size_t i{begin}; i < end; ++i)
+        {
+            const int *corners = &mesh.triangles[i * 3];
+            bool inFront = true;
+            int minX = INT32_MAX, minY = INT32_MAX, maxX = INT32_MIN, maxY = INT32_MIN;
+            for (int c{0}; c < 3; ++c)
+            {
+                inFront &= cameraPoints[corners[c]].z < -context.nearClippingPlane;
+                minX = std::min(minX, rasters[corners[c]].x);
+                maxX = std::max(maxX, rasters[corners[c]].x);
+                minY = std::min(minY, rasters[corners[c]].y);
+                maxY = std::max(maxY, rasters[corners[c]].y);
+            }
+            drawn[i] = inFront && maxX >= 0 && minX <= (int)imageWidth && maxY >= 0 && minY <= (int)imageHeight;
+            kept += drawn[i];
+        }
+        sliceStarts[t + 1] = kept;
+    });
+    for (unsigned t{0}; t < threadCount; ++t)
+    {
+        sliceStarts[t + 1] += sliceStarts[t];
+    }
+    PROFILE_COUNT("triangles_processed", triangleCount);
+    PROFILE_COUNT("triangles_culled", triangleCount - sliceStarts[threadCount]);
+
+    // Camera looks down -z, so the farthest triangle has the most negative depth and ascending keys put it first
+    std::vector<uint32_t> keys(sliceStarts[threadCount]), order(sliceStarts[threadCount]);
+    forEachSlice(triangleCount, threadCount, [&](size_t begin, size_t end, unsigned t)
+    {
+        size_t next = sliceStarts[t];
+        for (size_t i{begin}; i < end; ++i)
+        {
+            if (!drawn[i]) { continue; }
+            const int *corners = &mesh.triangles[i * 3];
+            keys[next] = floatSortKey(cameraPoints[corners[0]].z + cameraPoints[corners[1]].z + cameraPoints[corners[2]].z);
+            order[next++] = (uint32_t)i;
+        }
+    });
+    radixSort(keys, order, threadCount);
+
+    // Slices of the sorted triangles are written into separate strings and joined in order
+    std::vector<std::pmr::string> parts(threadCount);
+    forEachSlice(order.size(), threadCount, [&](size_t begin, size_t end, unsigned t)
+    {
+        PROFILE_SCOPE("svg_output");
+        for (size_t k{begin}; k < end; ++k)
+        {
+            const int *corners = &mesh.triangles[order[k] * 3];
+            const Vec3f &a = cameraPoints[corners[0]], &b = cameraPoints[corners[1]], &c = cameraPoints[corners[2]];
+            Vec3f normal = (b - a).crossProduct(c - a), centre = a + b + c;
+            float length = normal.length() * centre.length();
+            float facing = length > 0 ? std::abs(normal.dotProduct(centre)) / length : 0;
+            appendPolygon(parts[t], rasters[corners[0]], rasters[corners[1]], rasters[corners[2]], 50 + (int)(205 * facing));
+        }
+        PROFILE_COUNT("triangles_emitted", end - begin);
+    });
+    for (const std::pmr::string &part : parts)
+    {
+        svg += part;
+    }
+}
+
+// [comment]
+// Inverse of a camera transform made only of rotations and a translation, like the ones getCameraToWorld builds.
+// The rotation part is orthonormal, so its inverse is its transpose, and the translation is undone by rotating it back and negating it.
+// Much cheaper than the general Gauss-Jordan inverse when many frames need one.
+// [/comment]
+inline Matrix44f rigidInverse(const Matrix44f &m)
+{
+    Matrix44f inv
+    {
+        m[0][0], m[1][0], m[2][0], 0,
+        m[0][1], m[1][1], m[2][1], 0,
+        m[0][2], m[1][2], m[2][2], 0,
+        0, 0, 0, 1
+    };
+    inv[3][0] = -(m[3][0] * inv[0][0] + m[3][1] * inv[1][0] + m[3][2] * inv[2][0]);
+    inv[3][1] = -(m[3][0] * inv[0][1] + m[3][1] * inv[1][1] + m[3][2] * inv[2][1]);
+    inv[3][2] = -(m[3][0] * inv[0][2] + m[3][1] * inv[1][2] + m[3][2] * inv[2][2]);
+    return inv;
+}
+
+// [comment]
+// Renders a sequence of frames as the camera moves along a keyframed path, writing <context.filename>0000.svg, <context.filename>0001.svg, ...
+// The context's camera transform is ignored, every other setting applies to all frames.
+// Keyframes must be sorted by frame. Camera parameters are interpolated linearly between them and every frame's worldToCamera matrix
+// is computed up front. Frames are then pipelined: while one frame is being written to disk on another thread, the next one is projected.
+// [/comment]
+inline void renderAnimation
+(
+    const Mesh &mesh,                               // Object to draw
+    RenderContext &context,                         // Camera settings, and output file names before the frame number
+    const std::vector<CameraKeyframe> &keyframes,   // Camera path
+    int frameCount                                  // Number of frames to render
+)
+{
+    if (keyframes.empty() || frameCount <= 0) { return; }
+
+    // Interpolate the camera for every frame in one batch
+    std::vector<Matrix44f> worldToCamera(frameCount);
+    size_t k = 0;
+    for (int frame{0}; frame < frameCount; ++frame)
+    {
+        while (k + 1 < keyframes.size() && keyframes[k + 1].frame <= frame) { ++k; }
+
+        const CameraKeyframe &a = keyframes[k];
+        const CameraKeyframe &b = keyframes[std::min(k + 1, keyframes.size() - 1)];
+        float t = (b.frame > a.frame) ? std::clamp((frame - a.frame) / (b.frame - a.frame), 0.0f, 1.0f) : 0.0f;
+        auto lerp = [t](float p, float q) { return p + (q - p) * t; };
+
+        worldToCamera[frame] = rigidInverse(getCameraToWorld(lerp(a.s1, b.s1), lerp(a.s2, b.s2), lerp(a.s3, b.s3), lerp(a.x, b.x), lerp(a.y, b.y), lerp(a.z, b.z)));
+    }
+
+    // Two buffers: one being written out by the writer thread while the other is being filled.
+    // written[i] is available once buffer i may be refilled, ready[i] once it holds a frame to write.
+    std::pmr::string svg[2] = {std::pmr::string(&context.pool), std::pmr::string(&context.pool)};
+    std::binary_semaphore written[2] = {std::binary_semaphore(1), std::binary_semaphore(1)};
+    std::binary_semaphore ready[2] = {std::binary_semaphore(0), std::binary_semaphore(0)};
+
+    // One stream with its own buffer, reused for every file. Set up here rather than on the writer thread, which may only start
+    // once the loop below is past its first frames and would then allocate the buffer in the middle of the frames counted.
+    std::vector<char> streamBuffer(1 << 16);
+    std::ofstream ofs;
+    ofs.rdbuf()->pubsetbuf(streamBuffer.data(), streamBuffer.size());
+
+    std::thread writer([&]()
+    {
+        char filename[512];
+
+        for (int frame{0}; frame < frameCount; ++frame)
+        {
+            ready[frame % 2].acquire();
+            PROFILE_SCOPE("file_output");
+            std::snprintf(filename, sizeof(filename), "%s%04d.svg", context.filename.c_str(), frame);
+            ofs.open(filename);
+            ofs.write(svg[frame % 2].data(), svg[frame % 2].size());
+            ofs.close();
+            PROFILE_COUNT("bytes_written", svg[frame % 2].size());
+            written[frame % 2].release();
+        }
+    });
+
+#ifdef COUNT_ALLOCATIONS
+    size_t steadyStateAllocations = 0;
+#endif
+    for (int frame{0}; frame < frameCount; ++frame)
+    {
+#ifdef COUNT_ALLOCATIONS
+        // The first two frames grow the buffers, every frame after them should run without touching the heap
+        size_t before = allocationCount;
+#endif
+        written[frame % 2].acquire();
+        projectObject(mesh, context, worldToCamera[frame], svg[frame % 2]);
+        ready[frame % 2].release();
+#ifdef COUNT_ALLOCATIONS
+        if (frame >= 2) { steadyStateAllocations += allocationCount - before; }
+#endif
+    }
+    writer.join();
+
+#ifdef COUNT_ALLOCATIONS
+    std::cout << "Heap allocations after the first two frames: " << steadyStateAllocations << std::endl;
+#endif
+}
+
+// [comment]
+// Renders straight from a vertices file without loading it, so files with any number of objects render in bounded memory.
+// The file is read in chunks of chunkSize bytes on a separate thread, into two buffers: one is filled while the other is being parsed.
+// Only the vertices of the object currently being read are kept, and triangles are drawn through projectTriangles a batch at a time as
+// their indices are read, so a triangle line of any length is never held in memory. Memory use is two chunks, one batch and the current
+// object's vertices: an object's triangles may refer to any of its vertices, so a single object only renders if its vertices fit in memory.
+// Triangles referring to a vertex the object doesn't have are skipped.
+// [/comment]
+inline bool renderObjectStreamed
+(
+    const RenderContext &context,   // Camera and output settings
+    std::string inputFilename,      // Vertices file, in the format Mesh::load takes
+    size_t chunkSize                // Bytes read at a time
+)
+{
+    std::ifstream inputFile(inputFilename, std::ios::binary);
+    if (!inputFile.is_open())
+    {
+        std::cerr << "Could not open file";
+        return 0;
+    }
+
+    Matrix44f worldToCamera;
+    {
+        PROFILE_SCOPE("camera_inverse");
+        worldToCamera = context.cameraToWorld.inverse();
+    }
+
+    // Reader thread: fills buffer i % 2 once the parser has released it, and signals when it is full. A zero size marks the end of the file.
+    std::vector<char> buffers[2] = {std::vector<char>(chunkSize), std::vector<char>(chunkSize)};
+    size_t sizes[2] = {0, 0};
+    std::binary_semaphore empty[2] = {std::binary_semaphore(1), std::binary_semaphore(1)};
+    std::binary_semaphore full[2] = {std::binary_semaphore(0), std::binary_semaphore(0)};
+    std::thread reader([&]()
+    {
+        for (size_t i{0}; ; ++i)
+        {
+            empty[i % 2].acquire();
+            inputFile.read(buffers[i % 2].data(), chunkSize);
+            sizes[i % 2] = (size_t)inputFile.gcount();
+            full[i % 2].release();
+            if (sizes[i % 2] == 0) { break; }
+        }
+    });
+
+    // Every batch is written out as soon as it is drawn
+    std::ofstream ofs(context.filename);
+    std::pmr::string svg;
+    SvgSink sink(svg);
+    sink.begin(context.imageWidth, context.imageHeight);
+
+    // Current object's vertices, and the triangles read since the last batch was drawn
+    constexpr size_t BATCH_SIZE = 4096;
+    Mesh object;
+    size_t skipped = 0;
+    auto drawBatch = [&]()
+    {
+        projectTriangles(object, context, worldToCamera, 0, object.triangles.size() / 3, sink);
+        object.triangles.clear();
+        sink.write(ofs);
+        svg.clear();
+    };
+
+    std::string line;           // Partial line carried between chunks. Only vertex and header lines are collected, never the (long) triangle lines.
+    bool readingVertices = false;
+    bool readingTris = false;
+    uint64_t index = 0;
+    int corner = 0;
+    int triangle[3];
+    bool inNumber = false;
+
+    auto endIndex = [&]()
+    {
+        inNumber = false;
+        triangle[corner++] = (int)std::min<uint64_t>(index, INT32_MAX);
+        index = 0;
+        if (corner < 3) { return; }
+        corner = 0;
+
+        if (std::max({triangle[0], triangle[1], triangle[2]}) >= (int)object.vertices.size())
+        {
+            skipped++;
+            return;
+        }
+        object.triangles.insert(object.triangles.end(), triangle, triangle + 3);
+        if (object.triangles.size() == BATCH_SIZE * 3) { drawBatch(); }
+    };
+
+    auto endLine = [&]()
+    {
+        if (!line.empty() && line.back() == '\r') { line.pop_back(); }
+
+        if (line == "Array of vertices:")
+        {
+            // New object, the previous one's vertices are no longer referenced
+            readingVertices = true;
+            drawBatch();
+            object.vertices.clear();
+            object.vertices.shrink_to_fit();
+            object.triangles.shrink_to_fit();
+            object.arena.release();
+        } else if (line == "Array of connected vertices:")
+        {
+            readingVertices = false;
+            readingTris = true;
+        } else if (readingVertices)
+        {
+            float x, y, z;
+            if (std::sscanf(line.c_str(), "%f %f %f", &x, &y, &z) == 3)
+            {
+                object.vertices.emplace_back(x, y, z);
+            }
+        }
+        line.clear();
+    };
+
+    for (size_t i{0}; ; ++i)
+    {
+        full[i % 2].acquire();
+        const char *chunk = buffers[i % 2].data();
+        size_t size = sizes[i % 2];
+        if (size == 0) { break; }
+
+        for (size_t c{0}; c < size; ++c)
+        {
+            char ch = chunk[c];
+            if (readingTris)
+            {
+                // Indices are consumed digit by digit. Past any vertex count they only need to stay out of range, not exact.
+                if (ch >= '0' && ch <= '9')
+                {
+                    if (index <= INT32_MAX) { index = index * 10 + (ch - '0'); }
+                    inNumber = true;
+                } else
+                {
+                    if (inNumber) { endIndex(); }
+                    if (ch == '\n')
+                    {
+                        // A triangle left incomplete at the end of the line is dropped
+                        readingTris = false;
+                        corner = 0;
+                    }
+                }
+            } else if (ch == '\n')
+            {
+                endLine();
+            } else
+            {
+                line += ch;
+            }
+        }
+        empty[i % 2].release();
+    }
+    if (inNumber) { endIndex(); }
+    if (!line.empty()) { endLine(); }
+    reader.join();
+
+    drawBatch();
+    sink.end();
+    sink.write(ofs);
+    PROFILE_COUNT("bytes_written", (size_t)ofs.tellp());
+    if (skipped > 0) { std::cerr << "Skipped " << skipped << " triangles with vertex indices out of range" << std::endl; }
+    return 1;
+}
@@ -0,0 +1,301 @@
+// Resident render server: keeps a mesh loaded and renders it for requests coming in over a Unix domain socket, so a render costs
+// neither process startup nor parsing. Connections are handed to a fixed pool of workers through a bounded channel, so at most
+// workerCount renders run at once and, once the queue is full, new connections wait in the socket's backlog.
+// A worker serves one connection until the client closes it, so workerCount clients that keep their connections open, even idle
+// ones, hold every worker and the others wait until one of them disconnects. Clients should close a connection once done with it.
+//
+// Protocol, one request per line, any number of them per connection:
+//     <focal length> <aperture width> <aperture height> <near> <far> <s1> <s2> <s3> <x> <y> <z> <format>\n
+// where the camera is placed as by getCameraToWorld(s1, s2, s3, x, y, z) and format is "svg", "filled" for an svg of shaded
+// polygons (RenderMode::Filled), "ppm" for an image or "binary" for packed raster coordinates (see sinks.h). The reply is
+//     OK <size>\n<size bytes of output>
+// or ERROR <reason>\n. For example: printf '50 35 24 0.1 100 77 0 5 0.5 -9 3.5 svg\n' | nc -U /tmp/headphones.sock
+// Renders go through a RenderCache, so a camera asked for again is answered without drawing. The request line "stats" replies with
+// the cache's counters, in the same OK <size>\n form.
+#pragma once
+
+#include "renderer.h"
+#include "pipeline.h"
+#include "rendercache.h"
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+struct RenderRequest
+{
+    float focalLength, filmApertureWidth, filmApertureHeight, nearClippingPlane, farClippingPlane;
+    float s1, s2, s3, x, y, z;
+    std::string format = "svg";
+};
+
+inline bool parseRequest(const std::string &line, RenderRequest &request)
+{
+    char format[16];
+    int read = std::sscanf(line.c_str(), "%f %f %f %f %f %f %f %f %f %f %f %15s",
+                           &request.focalLength, &request.filmApertureWidth, &request.filmApertureHeight, &request.nearClippingPlane, &request.farClippingPlane,
+                           &request.s1, &request.s2, &request.s3, &request.x, &request.y, &request.z, format);
+    if (read != 12) { return false; }
+    request.format = format;
+    return true;
+}
+
+// Why the camera of a request can't be rendered, or null if it can. Anything else would divide by zero in the projection and cast the
+// resulting infinities and NaNs to int.
+inline const char *checkRequest(const RenderRequest &request)
+{
+    const float values[] = {request.focalLength, request.filmApertureWidth, request.filmApertureHeight, request.nearClippingPlane, request.farClippingPlane,
+                            request.s1, request.s2, request.s3, request.x, request.y, request.z};
+    for (float value : values)
+    {
+        if (!std::isfinite(value)) { return "parameters must be finite"; }
+    }
+    if (request.focalLength <= 0 || request.filmApertureWidth <= 0 || request.filmApertureHeight <= 0) { return "focal length and aperture must be positive"; }
+    if (request.nearClippingPlane <= 0 || request.farClippingPlane <= request.nearClippingPlane) { return "clipping planes must satisfy 0 < near < far"; }
+    return nullptr;
+}
+
+inline std::string formatRequest(const RenderRequest &request)
+{
+    char line[512];
+    std::snprintf(line, sizeof(line), "%.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %s\n",
+                  request.focalLength, request.filmApertureWidth, request.filmApertureHeight, request.nearClippingPlane, request.farClippingPlane,
+                  request.s1, request.s2, request.s3, request.x, request.y, request.z, request.format.c_str());
+    return line;
+}
+
+// Write all of data, however many calls it takes. Never raises SIGPIPE if the other end has gone.
+inline bool sendAll(int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent <= 0) { return false; }
+        data += sent;
+        size -= (size_t)sent;
+    }
+    return true;
+}
+
+// Longest request line accepted, far more than any request needs
+constexpr size_t MAX_LINE = 4096;
+
+// Next line from a socket, without the newline. pending holds what was read past the previous line.
+// Fails once MAX_LINE bytes have arrived without a newline, so a client can't make the server buffer without limit.
+inline bool receiveLine(int fd, std::string &pending, std::string &line)
+{
+    size_t newline;
+    while ((newline = pending.find('\n')) == std::string::npos)
+    {
+        if (pending.size() >= MAX_LINE) { return false; }
+        char buffer[4096];
+        ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+        if (received <= 0) { return false; }
+        pending.append(buffer, (size_t)received);
+    }
+    line = pending.substr(0, newline);
+    pending.erase(0, newline + 1);
+    return true;
+}
+
+inline int openSocket(const std::string &path, sockaddr_un &address)
+{
+    address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) { return -1; }
+    std::strcpy(address.sun_path, path.c_str());
+    return socket(AF_UNIX, SOCK_STREAM, 0);
+}
+
+inline bool sendReply(int fd, const char *data, size_t size)
+{
+    char header[32];
+    int headerSize = std::snprintf(header, sizeof(header), "OK %zu\n", size);
+    return sendAll(fd, header, (size_t)headerSize) && sendAll(fd, data, size);
+}
+
+// Wireframe of mesh in one of the formats that aren't svg text, "ppm" or "binary"
+inline std::string renderToBytes(const Mesh &mesh, const RenderContext &context, const std::string &format)
+{
+    std::ostringstream bytes;
+    if (format == "ppm")
+    {
+        RasterSink sink;
+        renderObject(mesh, context, sink);
+        sink.write(bytes);
+    } else
+    {
+        BinarySink sink;
+        renderObject(mesh, context, sink);
+        sink.write(bytes);
+    }
+    return bytes.str();
+}
+
+// [comment]
+// Serve renders of mesh on a Unix socket at socketPath until the socket fails. Each worker keeps one RenderContext for every request it
+// serves, so the output buffer and its memory pool are reused from one render to the next. All workers share cache.
+// [/comment]
+inline bool serveRenders(const Mesh &mesh, std::string socketPath, RenderCache &cache, unsigned workerCount = std::max(1u, std::thread::hardware_concurrency()))
+{
+    // No workers would leave the first connection queued forever
+    if (workerCount == 0) { workerCount = 1; }
+
+    sockaddr_un address;
+    int listener = openSocket(socketPath, address);
+    if (listener < 0) { return false; }
+
+    // A socket left by an earlier server is replaced, anything else at the path is left alone
+    struct stat existing;
+    if (lstat(socketPath.c_str(), &existing) == 0)
+    {
+        if (!S_ISSOCK(existing.st_mode))
+        {
+            std::cerr << socketPath << " exists and is not a socket" << std::endl;
+            close(listener);
+            return false;
+        }
+        unlink(socketPath.c_str());
+    }
+    if (bind(listener, (sockaddr *)&address, sizeof(address)) < 0 || listen(listener, 64) < 0)
+    {
+        std::cerr << "Could not listen on " << socketPath << std::endl;
+        close(listener);
+        return false;
+    }
+
+    Channel<int> connections(workerCount);
+    std::vector<std::thread> workers;
+    for (unsigned w{0}; w < workerCount; ++w)
+    {
+        workers.emplace_back([&mesh, &connections, &cache]()
+        {
+            RenderContext context(50, 35, 24, 0.1, 100, Matrix44f(), "");
+            std::string output;
+            while (std::optional<int> connection = connections.pop())
+            {
+                std::string pending, line;
+                while (receiveLine(*connection, pending, line))
+                {
+                    if (line == "stats")
+                    {
+                        RenderCache::Stats stats = cache.getStats();
+                        char text[160];
+                        int size = std::snprintf(text, sizeof(text), "memory_hits %llu\ndisk_hits %llu\nmisses %llu\nevictions %llu\n",
+                                                 (unsigned long long)stats.memoryHits, (unsigned long long)stats.diskHits,
+                                                 (unsigned long long)stats.misses, (unsigned long long)stats.evictions);
+                        if (!sendReply(*connection, text, (size_t)size)) { break; }
+                        continue;
+                    }
+
+                    RenderRequest request;
+                    if (!parseRequest(line, request))
+                    {
+                        sendAll(*connection, "ERROR malformed request\n", 24);
+                        continue;
+                    }
+                    if (request.format != "svg" && request.format != "filled" && request.format != "ppm" && request.format != "binary")
+                    {
+                        std::string error = "ERROR unknown format " + request.format + "\n";
+                        sendAll(*connection, error.data(), error.size());
+                        continue;
+                    }
+                    if (const char *reason = checkRequest(request))
+                    {
+                        std::string error = std::string("ERROR ") + reason + "\n";
+                        sendAll(*connection, error.data(), error.size());
+                        continue;
+                    }
+
+                    PROFILE_SCOPE("serve_request");
+                    context.focalLength = request.focalLength;
+                    context.filmApertureWidth = request.filmApertureWidth;
+                    context.filmApertureHeight = request.filmApertureHeight;
+                    context.nearClippingPlane = request.nearClippingPlane;
+                    context.farClippingPlane = request.farClippingPlane;
+                    context.cameraToWorld = getCameraToWorld(request.s1, request.s2, request.s3, request.x, request.y, request.z);
+                    context.mode = request.format == "filled" ? RenderMode::Filled : RenderMode::Wireframe;
+                    uint64_t key = renderKey(mesh, context, request.format);
+                    if (cache.get(key, output))
+                    {
+                        if (!sendReply(*connection, output.data(), output.size())) { break; }
+                        continue;
+                    }
+                    if (request.format == "ppm" || request.format == "binary")
+                    {
+                        output = renderToBytes(mesh, context, request.format);
+                        cache.put(key, output);
+                        if (!sendReply(*connection, output.data(), output.size())) { break; }
+                        continue;
+                    }
+                    projectObject(mesh, context, context.cameraToWorld.inverse(), context.svg);
+                    cache.put(key, std::string_view(context.svg.data(), context.svg.size()));
+                    if (!sendReply(*connection, context.svg.data(), context.svg.size())) { break; }
+                }
+                close(*connection);
+            }
+        });
+    }
+
+    // Accept on this thread. Pushing blocks while every worker is busy and the queue is full.
+    // A signal or a client giving up before its connection was accepted only costs that connection, anything else stops the server.
+    while (true)
+    {
+        int connection = accept(listener, nullptr, nullptr);
+        if (connection < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED || errno == EPROTO) { continue; }
+            std::cerr << "Could not accept on " << socketPath << ": " << std::strerror(errno) << std::endl;
+            break;
+        }
+        connections.push(connection);
+    }
+
+    connections.close();
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+    close(listener);
+    unlink(socketPath.c_str());
+    return true;
+}
+
+// Client side: send one request to a server and wait for its output
+inline bool requestRender(std::string socketPath, const RenderRequest &request, std::string &output)
+{
+    sockaddr_un address;
+    int fd = openSocket(socketPath, address);
+    if (fd < 0) { return false; }
+    if (connect(fd, (sockaddr *)&address, sizeof(address)) < 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    std::string line = formatRequest(request), pending, status;
+    bool ok = sendAll(fd, line.data(), line.size()) && receiveLine(fd, pending, status) && status.starts_with("OK ");
+    if (ok)
+    {
+        size_t size = std::strtoull(status.c_str() + 3, nullptr, 10);
+        output = pending;
+        char buffer[1 << 16];
+        while (output.size() < size)
+        {
+            ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+            if (received <= 0) { break; }
+            output.append(buffer, (size_t)received);
+        }
+        ok = output.size() == size;
+    } else if (!status.empty())
+    {
+        std::cerr << status << std::endl;
+    }
+    close(fd);
+    return ok;
+}
@@ -0,0 +1,236 @@
+// Output backends for the projection loop. A sink receives every triangle once it has been projected to raster space, with whether it
+// lies wholly in the image, and turns it into some output. The loop is a template on the sink type (see projectTriangles), so the sink's
+// calls are inlined into it and there is no virtual call per triangle. Adding a format means adding a sink, not another loop.
+//
+//     SvgSink     svg text, three lines per triangle, black if visible and red if not (the classic output)
+//     RasterSink  the same lines drawn into an RGB image, written as binary PPM
+//     BinarySink  raster coordinates as packed integers, for tools that want the projection without parsing text
+//     NullSink    only counts, so benchmarks can time projection alone
+#pragma once
+
+#include "geometry.h"
+#include <algorithm>
+#include <charconv>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <ostream>
+#include <string>
+#include <vector>
+
+template <typename Sink>
+concept OutputSink = requires(Sink sink, const Vec2i &r, bool visible, std::ostream &os)
+{
+    sink.begin(uint32_t(), uint32_t());    // Image width and height, before any triangle
+    sink.triangle(r, r, r, visible);       // Corners in raster space
+    sink.end();                            // After the last triangle
+    sink.write(os);                        // Everything since begin
+};
+
+// Append the decimal form of value without going through a stream
+inline void appendInt(std::pmr::string &s, int value)
+{
+    char digits[12];
+    char *end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+    s.append(digits, end);
+}
+
+// Append one svg line from a to b, black if visible and red if not
+inline void appendLine(std::pmr::string &s, const Vec2i &a, const Vec2i &b, int val)
+{
+    s += "<line x1=\"";
+    appendInt(s, a.x);
+    s += "\" y1=\"";
+    appendInt(s, a.y);
+    s += "\" x2=\"";
+    appendInt(s, b.x);
+    s += "\" y2=\"";
+    appendInt(s, b.y);
+    s += "\" style=\"stroke:rgb(";
+    appendInt(s, val);
+    s += ",0,0);stroke-width:1\" />\n";
+}
+
+// Append one svg triangle filled with grey level val, and outlined in it so that neighbours leave no cracks between them
+inline void appendPolygon(std::pmr::string &s, const Vec2i &a, const Vec2i &b, const Vec2i &c, int val)
+{
+    s += "<polygon points=\"";
+    appendInt(s, a.x);
+    s += ',';
+    appendInt(s, a.y);
+    s += ' ';
+    appendInt(s, b.x);
+    s += ',';
+    appendInt(s, b.y);
+    s += ' ';
+    appendInt(s, c.x);
+    s += ',';
+    appendInt(s, c.y);
+    s += "\" style=\"fill:rgb(";
+    appendInt(s, val);
+    s += ',';
+    appendInt(s, val);
+    s += ',';
+    appendInt(s, val);
+    s += ");stroke:rgb(";
+    appendInt(s, val);
+    s += ',';
+    appendInt(s, val);
+    s += ',';
+    appendInt(s, val);
+    s += ");stroke-width:1\" />\n";
+}
+
+// Appends to a string it doesn't own, so a caller's buffer (and its memory pool) can be reused from one render to the next.
+// Begin and end add the document's header and footer; leave them out to produce a fragment that is joined with others.
+class SvgSink
+{
+public:
+    SvgSink(std::pmr::string &svg) : _svg(svg) {}
+
+    void begin(uint32_t imageWidth, uint32_t imageHeight)
+    {
+        _svg += "<svg version=\"1.1\" xmlns:xlink=\"http://www.w3.org/1999/xlink\" xmlns=\"http://www.w3.org/2000/svg\" width=\"";
+        appendInt(_svg, (int)imageWidth);
+        _svg += "\" height=\"";
+        appendInt(_svg, (int)imageHeight);
+        _svg += "\">\n";
+    }
+
+    void triangle(const Vec2i &a, const Vec2i &b, const Vec2i &c, bool visible)
+    {
+        int val = visible ? 0 : 255; // Black if visible, red if not visible
+        appendLine(_svg, a, b, val);
+        appendLine(_svg, b, c, val);
+        appendLine(_svg, c, a, val);
+    }
+
+    void end() { _svg += "</svg>\n"; }
+    void write(std::ostream &os) const { os.write(_svg.data(), _svg.size()); }
+
+private:
+    std::pmr::string &_svg;
+};
+
+class RasterSink
+{
+public:
+    void begin(uint32_t imageWidth, uint32_t imageHeight)
+    {
+        _width = (int)imageWidth;
+        _height = (int)imageHeight;
+        _pixels.assign((size_t)_width * _height * 3, 255);
+    }
+
+    void triangle(const Vec2i &a, const Vec2i &b, const Vec2i &c, bool visible)
+    {
+        uint8_t red = visible ? 0 : 255;
+        line(a, b, red);
+        line(b, c, red);
+        line(c, a, red);
+    }
+
+    void end() {}
+
+    void write(std::ostream &os) const
+    {
+        os << "P6\n" << _width << " " << _height << "\n255\n";
+        os.write((const char *)_pixels.data(), (std::streamsize)_pixels.size());
+    }
+
+    const std::vector<uint8_t> &getPixels() const { return _pixels; }
+
+private:
+    // Clip the segment to the image (Liang-Barsky), so corners projected far outside it cost nothing, then step along it with Bresenham
+    void line(Vec2i a, Vec2i b, uint8_t red)
+    {
+        float t0 = 0, t1 = 1;
+        float dx = (float)(b.x - a.x), dy = (float)(b.y - a.y);
+        const float p[4] = {-dx, dx, -dy, dy};
+        const float q[4] = {(float)a.x, (float)(_width - 1 - a.x), (float)a.y, (float)(_height - 1 - a.y)};
+        for (int edge{0}; edge < 4; ++edge)
+        {
+            if (p[edge] == 0)
+            {
+                if (q[edge] < 0) { return; }
+                continue;
+            }
+            float t = q[edge] / p[edge];
+            if (p[edge] < 0) { t0 = std::max(t0, t); } else { t1 = std::min(t1, t); }
+            if (t0 > t1) { return; }
+        }
+        Vec2i from((int)(a.x + t0 * dx + 0.5f), (int)(a.y + t0 * dy + 0.5f)), to((int)(a.x + t1 * dx + 0.5f), (int)(a.y + t1 * dy + 0.5f));
+
+        int stepX = from.x < to.x ? 1 : -1, stepY = from.y < to.y ? 1 : -1;
+        int distanceX = std::abs(to.x - from.x), distanceY = -std::abs(to.y - from.y), error = distanceX + distanceY;
+        while (true)
+        {
+            if (from.x >= 0 && from.x < _width && from.y >= 0 && from.y < _height)
+            {
+                uint8_t *pixel = &_pixels[((size_t)from.y * _width + from.x) * 3];
+                pixel[0] = red;
+                pixel[1] = 0;
+                pixel[2] = 0;
+            }
+            if (from.x == to.x && from.y == to.y) { break; }
+            int doubled = 2 * error;
+            if (doubled >= distanceY) { error += distanceY; from.x += stepX; }
+            if (doubled <= distanceX) { error += distanceX; from.y += stepY; }
+        }
+    }
+
+    int _width = 0, _height = 0;
+    std::vector<uint8_t> _pixels;   // Rows top to bottom, 3 bytes per pixel
+};
+
+// Layout, all in the machine's byte order:
+//     "WIRE", uint32 width, uint32 height, uint32 triangle count
+//     per triangle: int32 x0, y0, x1, y1, x2, y2, uint32 visible
+class BinarySink
+{
+public:
+    void begin(uint32_t imageWidth, uint32_t imageHeight)
+    {
+        _bytes.clear();
+        _triangleCount = 0;
+        append("WIRE", 4);
+        uint32_t header[] = {imageWidth, imageHeight, 0};
+        append(header, sizeof(header));
+    }
+
+    void triangle(const Vec2i &a, const Vec2i &b, const Vec2i &c, bool visible)
+    {
+        int32_t record[] = {a.x, a.y, b.x, b.y, c.x, c.y, visible};
+        append(record, sizeof(record));
+        _triangleCount++;
+    }
+
+    // The count is only known now, so it is written over its placeholder in the header
+    void end() { std::memcpy(&_bytes[12], &_triangleCount, sizeof(_triangleCount)); }
+
+    void write(std::ostream &os) const { os.write(_bytes.data(), (std::streamsize)_bytes.size()); }
+
+private:
+    void append(const void *data, size_t size) { _bytes.insert(_bytes.end(), (const char *)data, (const char *)data + size); }
+
+    std::vector<char> _bytes;
+    uint32_t _triangleCount = 0;
+};
+
+// Every triangle still has to be projected to decide whether it is visible, and counting visible ones keeps the compiler from
+// removing the projection as unused, so timing a render into this sink times projection alone
+class NullSink
+{
+public:
+    void begin(uint32_t, uint32_t) {}
+    void triangle(const Vec2i &, const Vec2i &, const Vec2i &, bool visible)
+    {
+        triangleCount++;
+        visibleCount += visible;
+    }
+    void end() {}
+    void write(std::ostream &) const {}
+
+    size_t triangleCount = 0, visibleCount = 0;
+};
@@ -6,13 +6,11 @@
 #include <vector>
 #include <cmath>
 #include <numbers>
+#include <span>
+#include "matrix.h"
 
-typedef struct  
-{
-    float x;
-    float y;
-    float z;
-} Point_t;
+// x, y and z coordinates
+typedef Vec<3, float> Point_t;
 
 // Screen Dimensions
 int screenWidth = 512, screenHeight = 512;
@@ -20,8 +18,7 @@ int screenWidth = 512, screenHeight = 512;
 // Distance the canvas is from the apex of the viewing frustrum (where the camera is)
 float canvasDist = 1;
 
-void applyTransformR3(std::vector<std::vector<float>> matrix, Point_t& point);
-void printCoords(std::vector<Point_t> matrix);
+void printCoords(std::span<const Point_t> points);
 
 
 int main(int argc, char const *argv[])
@@ -55,54 +52,32 @@ int main(int argc, char const *argv[])
     float theta = std::numbers::pi/12;
 
     // Matrix for rotation around x-axis by pi/12 radians
-    std::vector<std::vector<float>> rot_x = 
-    {   
+    Mat<3, 3, float> rot_x = 
+    {{
         {1, 0, 0},
         {0, (float)cos(theta), (float)sin(theta)},
         {0, -(float)sin(theta), (float)cos(theta)}
-    };
+    }};
     
     // Original
     std::cout << "Original Coords" << std::endl;
     printCoords(corners);
 
     // Transformation
-    for (Point_t& corner : corners)
-    {
-        applyTransformR3(rot_x, corner);
-    }
+    transform<3, float>(rot_x, corners);
     std::cout << "\nRotation by pi/12 around x-axis" << std::endl;
     printCoords(corners);
 
     return 0;
 }
 
-void applyTransformR3(std::vector<std::vector<float>> matrix, Point_t& point)
-{
-    std::vector<float> vector = {point.x, point.y, point.z};
-    int rows = matrix.size();
-    int cols = matrix[0].size();
-
-    std::vector<float> result(rows);
-
-    for (int i = 0; i < rows; ++i) 
-    {
-        for (int j = 0; j < cols; ++j) 
-        {
-            result[i] += matrix[i][j] * vector[j];
-        }
-    }
-
-    point = {result[0], result[1], result[2]};    
-}
-
-void printCoords(std::vector<Point_t> matrix)
+void printCoords(std::span<const Point_t> points)
 {
-    for (int i{0}; Point_t point : matrix)
+    for (int i{0}; const Point_t& point : points)
     {
         // Outputs the x and y projections onto a canvas [-1, 1] (can be out of bounds!)
-        float x_proj = (point.x / -point.z) * canvasDist;
-        float y_proj = (point.y / -point.z) * canvasDist;
+        float x_proj = (point[0] / -point[2]) * canvasDist;
+        float y_proj = (point[1] / -point[2]) * canvasDist;
 
         // Normalize to [0, 1] and then to the screen's dimensions.
         x_proj = screenWidth * (x_proj + 1) / 2;
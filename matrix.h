@@ -0,0 +1,75 @@
+// Fixed size vectors and matrices for quick transforms. The dimensions are template parameters, so the coefficients live inline
+// (on the stack, never the heap) and every product is unrolled at compile time into a plain sum of multiplications.
+// The names don't clash with geometry.h (Vec2, Vec3, Matrix44), so both can be included together.
+//
+// Vectors are columns: a matrix transforms a point with m * p, like the rotation in cube.cc.
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <utility>
+
+template<size_t N, typename T = float>
+struct Vec
+{
+    T v[N] = {};
+
+    constexpr T& operator [] (size_t i) { return v[i]; }
+    constexpr const T& operator [] (size_t i) const { return v[i]; }
+};
+
+template<size_t R, size_t C, typename T = float>
+struct Mat
+{
+    T m[R][C] = {};
+
+    constexpr T* operator [] (size_t i) { return m[i]; }
+    constexpr const T* operator [] (size_t i) const { return m[i]; }
+
+    static constexpr Mat identity() requires (R == C)
+    {
+        Mat id;
+        for (size_t i{0}; i < R; ++i) { id.m[i][i] = 1; }
+        return id;
+    }
+
+    constexpr Vec<R, T> operator * (const Vec<C, T> &x) const
+    {
+        return multiply(x, std::make_index_sequence<R>{});
+    }
+
+    template<size_t K>
+    constexpr Mat<R, K, T> operator * (const Mat<C, K, T> &b) const
+    {
+        Mat<R, K, T> c;
+        for (size_t i{0}; i < R; ++i)
+        {
+            for (size_t j{0}; j < K; ++j)
+            {
+                for (size_t k{0}; k < C; ++k) { c.m[i][j] += m[i][k] * b.m[k][j]; }
+            }
+        }
+        return c;
+    }
+
+private:
+    // One entry of the result per row, each a dot product expanded over the columns: no loops are left at run time
+    template<size_t... I>
+    constexpr Vec<R, T> multiply(const Vec<C, T> &x, std::index_sequence<I...>) const
+    {
+        return Vec<R, T>{{dot(m[I], x, std::make_index_sequence<C>{})...}};
+    }
+
+    template<size_t... J>
+    static constexpr T dot(const T (&row)[C], const Vec<C, T> &x, std::index_sequence<J...>)
+    {
+        return ((row[J] * x[J]) + ...);
+    }
+};
+
+// Transform a batch of points in place
+template<size_t N, typename T>
+constexpr void transform(const Mat<N, N, T> &m, std::span<Vec<N, T>> points)
+{
+    for (Vec<N, T> &p : points) { p = m * p; }
+}